@@ -0,0 +1,351 @@
+/**
+ * @file bench.c - Microbenchmarks of the arena allocator against malloc, jemalloc and mimalloc
+ *
+ * Prints one CSV row per measurement:
+ *     benchmark,allocator,threads,ops,ns_per_op,mops_per_sec
+ *
+ * jemalloc and mimalloc are loaded with dlopen and skipped when they aren't installed.
+ * An optional argument scales the number of operations (default 1.0).
+ */
+
+#define _DEFAULT_SOURCE
+#include "../sp_arena.h"
+#include <dlfcn.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define BENCH_MAX_THREADS 64
+#define BENCH_BATCH 1024
+
+/* A malloc compatible allocator used as a baseline */
+typedef struct {
+    const char *name;
+    void *(*malloc_fn)(size_t);
+    void *(*calloc_fn)(size_t, size_t);
+    void *(*realloc_fn)(void *, size_t);
+    void (*free_fn)(void *);
+} baseline;
+
+static baseline baselines[3];
+static size_t baseline_count;
+static double scale = 1.0;
+
+/* Keeps the compiler from dropping allocations nobody reads */
+static volatile uintptr_t sink;
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+static size_t scaled(size_t ops) {
+    size_t n = (size_t)((double)ops * scale);
+    return n < BENCH_BATCH ? BENCH_BATCH : n;
+}
+
+static void report(const char *benchmark, const char *allocator, size_t threads, size_t ops, uint64_t ns) {
+    double ns_per_op = (double)ns / (double)ops;
+    printf("%s,%s,%zu,%zu,%.3f,%.3f\n", benchmark, allocator, threads, ops, ns_per_op, 1e3 / ns_per_op);
+    fflush(stdout);
+}
+
+/* Mixed sizes between 8 and 512 bytes, the same sequence for every allocator */
+static size_t mixed_size(uint32_t *state) {
+    *state = *state * 1664525u + 1013904223u;
+    return 8 + (*state >> 16) % 505;
+}
+
+/* ====================== Baselines ====================== */
+
+static void load_baseline(const char *name, const char *library, const char *prefix) {
+    void *handle = dlopen(library, RTLD_NOW | RTLD_LOCAL);
+    if (!handle) {
+        fprintf(stderr, "bench: %s not found, skipping\n", name);
+        return;
+    }
+
+    char symbol[64];
+    baseline *b = &baselines[baseline_count];
+    b->name = name;
+    snprintf(symbol, sizeof(symbol), "%smalloc", prefix);
+    *(void **)&b->malloc_fn = dlsym(handle, symbol);
+    snprintf(symbol, sizeof(symbol), "%scalloc", prefix);
+    *(void **)&b->calloc_fn = dlsym(handle, symbol);
+    snprintf(symbol, sizeof(symbol), "%srealloc", prefix);
+    *(void **)&b->realloc_fn = dlsym(handle, symbol);
+    snprintf(symbol, sizeof(symbol), "%sfree", prefix);
+    *(void **)&b->free_fn = dlsym(handle, symbol);
+
+    if (!b->malloc_fn || !b->calloc_fn || !b->realloc_fn || !b->free_fn) {
+        fprintf(stderr, "bench: %s is missing symbols, skipping\n", name);
+        dlclose(handle);
+        return;
+    }
+    baseline_count++;
+}
+
+static void load_baselines(void) {
+    baselines[baseline_count++] = (baseline){ "malloc", malloc, calloc, realloc, free };
+    load_baseline("jemalloc", "libjemalloc.so.2", "");
+    load_baseline("mimalloc", "libmimalloc.so.2", "mi_");
+}
+
+/* ====================== Single threaded ====================== */
+
+/* Batches of allocations, the arena is cleared and malloc frees after each batch */
+static void bench_alloc(const char *benchmark, bool mixed) {
+    size_t ops = scaled(10000000);
+    void *ptrs[BENCH_BATCH];
+
+    sp_arena_config config = SP_ARENA_DEFAULT_CONFIG;
+    config.sync = SP_ARENA_SYNC_NONE;
+    sp_arena *arena = sp_arena_create_with_config(config);
+    uint32_t state = 1;
+    uint64_t start = now_ns();
+    for (size_t done = 0; done < ops; done += BENCH_BATCH) {
+        for (size_t i = 0; i < BENCH_BATCH; i++) {
+            ptrs[i] = sp_arena_alloc(arena, mixed ? mixed_size(&state) : 16);
+        }
+        sink = (uintptr_t)ptrs[BENCH_BATCH - 1];
+        sp_arena_clear(arena);
+    }
+    report(benchmark, "sp_arena", 1, ops, now_ns() - start);
+    sp_arena_destroy(arena);
+
+    for (size_t b = 0; b < baseline_count; b++) {
+        state = 1;
+        start = now_ns();
+        for (size_t done = 0; done < ops; done += BENCH_BATCH) {
+            for (size_t i = 0; i < BENCH_BATCH; i++) {
+                ptrs[i] = baselines[b].malloc_fn(mixed ? mixed_size(&state) : 16);
+            }
+            sink = (uintptr_t)ptrs[BENCH_BATCH - 1];
+            for (size_t i = 0; i < BENCH_BATCH; i++) baselines[b].free_fn(ptrs[i]);
+        }
+        report(benchmark, baselines[b].name, 1, ops, now_ns() - start);
+    }
+}
+
+/* A temp scope around a few allocations, the cost of a request's scratch memory */
+static void bench_temp(void) {
+    size_t ops = scaled(5000000);
+    sp_arena_config config = SP_ARENA_DEFAULT_CONFIG;
+    config.sync = SP_ARENA_SYNC_NONE;
+    sp_arena *arena = sp_arena_create_with_config(config);
+    sp_arena_alloc(arena, 64);
+
+    uint64_t start = now_ns();
+    for (size_t i = 0; i < ops; i++) {
+        sp_arena_temp temp = sp_arena_temp_begin(arena);
+        sink = (uintptr_t)sp_arena_alloc(arena, 32);
+        sink = (uintptr_t)sp_arena_alloc(arena, 128);
+        sp_arena_temp_end(temp);
+    }
+    report("temp_scope", "sp_arena", 1, ops, now_ns() - start);
+
+    // Scopes that spill into a second block and rewind past it
+    ops = scaled(500000);
+    start = now_ns();
+    for (size_t i = 0; i < ops; i++) {
+        sp_arena_temp temp = sp_arena_temp_begin(arena);
+        sink = (uintptr_t)sp_arena_alloc(arena, SP_ARENA_DEFAULT_BLOCK_SIZE / 2);
+        sink = (uintptr_t)sp_arena_alloc(arena, SP_ARENA_DEFAULT_BLOCK_SIZE / 2);
+        sp_arena_temp_end(temp);
+    }
+    report("temp_scope_spill", "sp_arena", 1, ops, now_ns() - start);
+    sp_arena_destroy(arena);
+}
+
+/* Grow a buffer 16 bytes at a time up to 64 KB, like a string builder */
+static void bench_resize(void) {
+    size_t rounds = scaled(2000) / 64;
+    size_t steps = KB(64) / 16 - 1;
+    size_t ops = rounds * steps;
+
+    sp_arena_config config = SP_ARENA_DEFAULT_CONFIG;
+    config.sync = SP_ARENA_SYNC_NONE;
+    sp_arena *arena = sp_arena_create_with_config(config);
+    uint64_t start = now_ns();
+    for (size_t r = 0; r < rounds; r++) {
+        sp_arena_alloc(arena, 8);  // Keep the buffer off the block start
+        char *buffer = sp_arena_alloc(arena, 16);
+        for (size_t size = 32; size <= KB(64); size += 16) {
+            buffer = sp_arena_resize(arena, buffer, size - 16, size);
+            buffer[size - 1] = 1;
+        }
+        sink = (uintptr_t)buffer;
+        sp_arena_clear(arena);
+    }
+    report("resize_grow", "sp_arena", 1, ops, now_ns() - start);
+    sp_arena_destroy(arena);
+
+    for (size_t b = 0; b < baseline_count; b++) {
+        start = now_ns();
+        for (size_t r = 0; r < rounds; r++) {
+            char *buffer = baselines[b].malloc_fn(16);
+            for (size_t size = 32; size <= KB(64); size += 16) {
+                buffer = baselines[b].realloc_fn(buffer, size);
+                buffer[size - 1] = 1;
+            }
+            sink = (uintptr_t)buffer;
+            baselines[b].free_fn(buffer);
+        }
+        report("resize_grow", baselines[b].name, 1, ops, now_ns() - start);
+    }
+}
+
+/* Zeroed 256 byte and 16 KB allocations */
+static void bench_calloc(const char *benchmark, size_t size, size_t ops) {
+    ops = scaled(ops);
+    size_t batch = KB(256) / size;
+    void *ptrs[BENCH_BATCH];
+    if (batch > BENCH_BATCH) batch = BENCH_BATCH;
+
+    sp_arena_config config = SP_ARENA_DEFAULT_CONFIG;
+    config.sync = SP_ARENA_SYNC_NONE;
+    config.block_size = MB(1);
+    sp_arena *arena = sp_arena_create_with_config(config);
+    uint64_t start = now_ns();
+    for (size_t done = 0; done < ops; done += batch) {
+        for (size_t i = 0; i < batch; i++) ptrs[i] = sp_arena_calloc(arena, size);
+        sink = (uintptr_t)ptrs[batch - 1];
+        sp_arena_clear(arena);
+    }
+    report(benchmark, "sp_arena", 1, ops, now_ns() - start);
+    sp_arena_destroy(arena);
+
+    for (size_t b = 0; b < baseline_count; b++) {
+        start = now_ns();
+        for (size_t done = 0; done < ops; done += batch) {
+            for (size_t i = 0; i < batch; i++) ptrs[i] = baselines[b].calloc_fn(1, size);
+            sink = (uintptr_t)ptrs[batch - 1];
+            for (size_t i = 0; i < batch; i++) baselines[b].free_fn(ptrs[i]);
+        }
+        report(benchmark, baselines[b].name, 1, ops, now_ns() - start);
+    }
+}
+
+/* ====================== Multithreaded ====================== */
+
+typedef struct {
+    sp_arena *arena;
+    const baseline *baseline;
+    size_t ops;
+    pthread_barrier_t *barrier;
+    uint64_t start;             /* Set by the thread once the barrier releases it */
+    uint64_t end;               /* Set by the thread after its last operation */
+} bench_thread;
+
+/* Every thread allocates 16 to 64 bytes from the one shared arena, which is never cleared mid run */
+static void *arena_thread(void *arg) {
+    bench_thread *t = arg;
+    pthread_barrier_wait(t->barrier);
+    t->start = now_ns();
+    uint32_t state = 1;
+    for (size_t i = 0; i < t->ops; i++) {
+        sink = (uintptr_t)sp_arena_alloc(t->arena, 16 + (mixed_size(&state) & 48));
+    }
+    t->end = now_ns();
+    return NULL;
+}
+
+static void *baseline_thread(void *arg) {
+    bench_thread *t = arg;
+    void *ptrs[BENCH_BATCH];
+    pthread_barrier_wait(t->barrier);
+    t->start = now_ns();
+    uint32_t state = 1;
+    for (size_t done = 0; done < t->ops; done += BENCH_BATCH) {
+        for (size_t i = 0; i < BENCH_BATCH; i++) ptrs[i] = t->baseline->malloc_fn(16 + (mixed_size(&state) & 48));
+        sink = (uintptr_t)ptrs[BENCH_BATCH - 1];
+        for (size_t i = 0; i < BENCH_BATCH; i++) t->baseline->free_fn(ptrs[i]);
+    }
+    t->end = now_ns();
+    return NULL;
+}
+
+/* Run `threads` threads after a common start, returns the wall time from the first thread 
+ * starting to the last one finishing. Each thread reads the clock itself, the main thread may 
+ * only wake from the barrier after fast workers are done */
+static uint64_t run_threads(size_t threads, void *(*fn)(void *), sp_arena *arena, const baseline *b, size_t ops) {
+    pthread_t handles[BENCH_MAX_THREADS];
+    bench_thread args[BENCH_MAX_THREADS];
+    pthread_barrier_t barrier;
+    pthread_barrier_init(&barrier, NULL, (unsigned)threads + 1);
+
+    for (size_t i = 0; i < threads; i++) {
+        args[i] = (bench_thread){ arena, b, ops, &barrier, 0, 0 };
+        pthread_create(&handles[i], NULL, fn, &args[i]);
+    }
+
+    pthread_barrier_wait(&barrier);
+    for (size_t i = 0; i < threads; i++) pthread_join(handles[i], NULL);
+
+    uint64_t start = args[0].start, end = args[0].end;
+    for (size_t i = 1; i < threads; i++) {
+        if (args[i].start < start) start = args[i].start;
+        if (args[i].end > end) end = args[i].end;
+    }
+    uint64_t elapsed = end - start;
+
+    pthread_barrier_destroy(&barrier);
+    return elapsed;
+}
+
+static void bench_threads(void) {
+    static const struct {
+        const char *name;
+        sp_arena_sync_t sync;
+    } modes[] = {
+        { "sp_arena_mutex", SP_ARENA_SYNC_MUTEX },
+        { "sp_arena_thread_cache", SP_ARENA_SYNC_THREAD_CACHE },
+        { "sp_arena_atomic", SP_ARENA_SYNC_ATOMIC },
+    };
+
+    for (size_t threads = 1; threads <= BENCH_MAX_THREADS; threads *= 2) {
+        size_t ops = scaled(2000000) / threads;
+        ops -= ops % BENCH_BATCH;
+        if (ops == 0) ops = BENCH_BATCH;
+
+        for (size_t m = 0; m < ArrayLen(modes); m++) {
+            sp_arena_config config = SP_ARENA_DEFAULT_CONFIG;
+            config.sync = modes[m].sync;
+            config.block_size = MB(4);
+            sp_arena *arena = sp_arena_create_with_config(config);
+            uint64_t elapsed = run_threads(threads, arena_thread, arena, NULL, ops);
+            report("threads_mixed", modes[m].name, threads, ops * threads, elapsed);
+            sp_arena_destroy(arena);
+        }
+
+        for (size_t b = 0; b < baseline_count; b++) {
+            uint64_t elapsed = run_threads(threads, baseline_thread, NULL, &baselines[b], ops);
+            report("threads_mixed", baselines[b].name, threads, ops * threads, elapsed);
+        }
+    }
+}
+
+int main(int argc, char **argv) {
+    if (argc > 1) {
+        scale = atof(argv[1]);
+        if (scale <= 0.0) {
+            fprintf(stderr, "usage: %s [scale]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    load_baselines();
+    printf("benchmark,allocator,threads,ops,ns_per_op,mops_per_sec\n");
+
+    bench_alloc("alloc_small", false);
+    bench_alloc("alloc_mixed", true);
+    bench_temp();
+    bench_resize();
+    bench_calloc("calloc_256", 256, 5000000);
+    bench_calloc("calloc_16k", KB(16), 200000);
+    bench_threads();
+    return 0;
+}
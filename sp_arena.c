@@ -1,16 +1,88 @@
+/* mmap flags and madvise are only declared with the default feature set under -std=c17 */
+#if !defined(_WIN32) && !defined(_DEFAULT_SOURCE)
+#define _DEFAULT_SOURCE
+#endif
+
+/* Keeps the profiling macros away from the library's own allocation calls */
+#define SP_ARENA_SOURCE_
+
 #include "sp_arena.h"
 #include <assert.h>
 #include <string.h>
 #include <stdint.h>
+#include <stdarg.h>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#if defined(__linux__)
+#include <sys/syscall.h>
+#endif
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+#if SP_ARENA_STATS
+#include <time.h>
+#endif
+
+#if SP_ARENA_DEBUG && defined(__has_feature)
+#if __has_feature(address_sanitizer)
+#define SP_ARENA_ASAN 1
+#endif
+#endif
+#if SP_ARENA_DEBUG && defined(__SANITIZE_ADDRESS__)
+#define SP_ARENA_ASAN 1
+#endif
+
+#ifdef SP_ARENA_ASAN
+#include <sanitizer/asan_interface.h>
+#endif
 
 const sp_arena_config SP_ARENA_DEFAULT_CONFIG = {
     .block_size = SP_ARENA_DEFAULT_BLOCK_SIZE, 
     .alignment = SP_ARENA_DEFAULT_ALIGNMENT, 
     .fixed_size = false, 
     .allocator = SP_ARENA_DEFAULT_ALLOCATOR, 
-    .deallocator = SP_ARENA_DEFAULT_DEALLOCATOR
+    .deallocator = SP_ARENA_DEFAULT_DEALLOCATOR, 
+    .sync = SP_ARENA_DEFAULT_SYNC, 
+    .thread_chunk_size = SP_ARENA_DEFAULT_THREAD_CHUNK_SIZE, 
+    .reserve_size = 0, 
+    .commit_size = SP_ARENA_DEFAULT_COMMIT_SIZE, 
+    .decommit_on_clear = false, 
+    .huge_page_size = 0, 
+    .numa_policy = SP_ARENA_NUMA_NONE, 
+    .numa_node = 0, 
+    .growth_factor = 1.0, 
+    .max_block_size = 0, 
+    .request_multiple = 0, 
+    .large_threshold = 0, 
+    .decay_clears = 0, 
+    .retain_large = false, 
+    .zeroed_allocator = false, 
+    .clear_mode = SP_ARENA_CLEAR_NONE, 
+    .isolate = false, 
+    .guard_pages = false, 
+    .prefetch_watermark = 0.0, 
+    .prefetch_populate = false, 
+    .prefetch_thread = false
 };
 
+#if SP_ARENA_THREAD_SAFE 
+SP_ARENA_THREAD_LOCAL sp_arena_thread_chunk sp_arena_thread_chunks[SP_ARENA_THREAD_CHUNK_SLOTS];
+static _Thread_local size_t thread_chunk_victim;
+
+/* Epochs are unique across all arenas, so a stale chunk can never match a new arena */
+static uint64_t epoch_counter;
+#endif
+
 
 static inline bool is_power_of_two(size_t n) {
     return (n != 0) && ((n & (n - 1))) == 0; 
@@ -30,66 +102,617 @@ static inline void *align_forward_ptr(void *ptr, size_t align) {
     return (void *)aligned;
 }
 
-/* Create a new block for an arena */
-static sp_arena_block* sp_arena_create_block(sp_arena *arena, size_t min_size) {
-    size_t block_size = arena->config.block_size;
+/* Align a used offset so the address it maps to in the block is aligned */
+static inline size_t align_offset(const sp_arena_block *block, size_t used, size_t align) {
+    uintptr_t memory = (uintptr_t)sp_arena_block_memory(block);
+    return align_forward(memory + used, align) - memory;
+}
+
+/* Virtual memory helpers for reserved arenas */
+static size_t os_page_size(void) {
+#if defined(_WIN32)
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return (size_t)info.dwPageSize;
+#else
+    long size = sysconf(_SC_PAGESIZE);
+    return size > 0 ? (size_t)size : 4096;
+#endif
+}
+
+/* Index of the highest set bit, n must be non-zero */
+static inline size_t log2_size(size_t n) {
+#if defined(__GNUC__) || defined(__clang__)
+    return (size_t)(63 - __builtin_clzll((unsigned long long)n));
+#else
+    size_t log = 0;
+    while (n >>= 1) log++;
+    return log;
+#endif
+}
+
+/* Index of the lowest set bit, n must be non-zero */
+static inline size_t lowest_bit(uint64_t n) {
+#if defined(__GNUC__) || defined(__clang__)
+    return (size_t)__builtin_ctzll(n);
+#else
+    size_t index = 0;
+    while (!(n & 1)) { n >>= 1; index++; }
+    return index;
+#endif
+}
+
+/* Map pages aligned to `align`, either committed or only reserved */
+static void *os_map(size_t size, size_t align, bool commit) {
+#if defined(_WIN32)
+    Unused(align)
+    return VirtualAlloc(NULL, size, commit ? MEM_RESERVE | MEM_COMMIT : MEM_RESERVE, 
+                        commit ? PAGE_READWRITE : PAGE_NOACCESS);
+#else
+    size_t extra = align > os_page_size() ? align : 0;
+    int prot = commit ? PROT_READ | PROT_WRITE : PROT_NONE;
+    int flags = MAP_PRIVATE | MAP_ANONYMOUS | (commit ? 0 : MAP_NORESERVE);
+
+    char *ptr = mmap(NULL, size + extra, prot, flags, -1, 0);
+    if (ptr == MAP_FAILED) return NULL;
+
+    // Trim the over-allocation so the mapping starts on an `align` boundary 
+    if (extra) {
+        char *aligned = align_forward_ptr(ptr, align);
+        if (aligned > ptr) munmap(ptr, aligned - ptr);
+        if (ptr + extra > aligned) munmap(aligned + size, ptr + extra - aligned);
+        ptr = aligned;
+    }
+    return ptr;
+#endif
+}
+
+/* Reserve address space without backing it with memory */
+static void *os_reserve(size_t size, size_t align) {
+    return os_map(size, align, false);
+}
+
+/* Map committed pages backed by huge pages: hugetlb pages if the system has them, 
+ * otherwise a huge page aligned mapping marked for transparent huge pages */
+static void *os_map_huge(size_t size, size_t huge_page_size) {
+#if defined(MAP_HUGETLB)
+    int flags = MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB;
+#if defined(MAP_HUGE_SHIFT)
+    flags |= (int)log2_size(huge_page_size) << MAP_HUGE_SHIFT;
+#endif
+    void *huge = mmap(NULL, size, PROT_READ | PROT_WRITE, flags, -1, 0);
+    if (huge != MAP_FAILED) return huge;
+#endif
+
+    void *ptr = os_map(size, huge_page_size, true);
+#if defined(MADV_HUGEPAGE)
+    if (ptr) madvise(ptr, size, MADV_HUGEPAGE);
+#endif
+    return ptr;
+}
+
+/* Bind a mapping to a NUMA node before its pages are first touched */
+static void os_bind_node(void *ptr, size_t size, int node) {
+#if defined(__linux__) && defined(SYS_mbind)
+    enum { MPOL_BIND_ = 2, MASK_BITS = 8 * sizeof(unsigned long) };
+    unsigned long mask[SP_ARENA_MAX_NUMA_NODES / MASK_BITS + 1] = {0};
+    if (node < 0 || node >= SP_ARENA_MAX_NUMA_NODES) return;
+
+    mask[node / MASK_BITS] |= 1UL << (node % MASK_BITS);
+    syscall(SYS_mbind, ptr, size, MPOL_BIND_, mask, (unsigned long)SP_ARENA_MAX_NUMA_NODES + 1, 0);
+#else
+    Unused(ptr)
+    Unused(size)
+    Unused(node)
+#endif
+}
+
+/* NUMA node of the CPU the calling thread runs on */
+static int os_current_node(void) {
+#if defined(__linux__) && defined(SYS_getcpu)
+    unsigned cpu = 0, node = 0;
+    if (syscall(SYS_getcpu, &cpu, &node, NULL) == 0) return (int)node;
+#endif
+    return 0;
+}
+
+/* Make reserved pages usable, they read as zero until written */
+static bool os_commit(void *ptr, size_t size) {
+#if defined(_WIN32)
+    return VirtualAlloc(ptr, size, MEM_COMMIT, PAGE_READWRITE) != NULL;
+#else
+    return mprotect(ptr, size, PROT_READ | PROT_WRITE) == 0;
+#endif
+}
+
+/* Give committed pages back to the OS, keeping the address space reserved */
+static void os_decommit(void *ptr, size_t size) {
+#if defined(_WIN32)
+    VirtualFree(ptr, size, MEM_DECOMMIT);
+#else
+    madvise(ptr, size, MADV_DONTNEED);
+    mprotect(ptr, size, PROT_NONE);
+#endif
+}
+
+static void os_release(void *ptr, size_t size) {
+#if defined(_WIN32)
+    Unused(size)
+    VirtualFree(ptr, 0, MEM_RELEASE);
+#else
+    munmap(ptr, size);
+#endif
+}
+
+/* Fault in the pages of a range ahead of use, keeping their contents */
+static void os_populate(void *ptr, size_t size, size_t page_size) {
+    char *start = align_forward_ptr(ptr, page_size);
+    char *end = (char *)ptr + size;
+    if (start >= end) return;
+
+#if defined(MADV_POPULATE_WRITE)
+    // Linux 5.14+ faults the whole range in one call, older kernels reject the advice
+    size_t length = (size_t)(end - start) & ~(page_size - 1);
+    if (length && madvise(start, length, MADV_POPULATE_WRITE) == 0) start += length;
+#endif
+
+    // Touch one byte per page, writing back what was read so zeroed memory stays zero
+    for (volatile char *page = start; page < end; page += page_size) *page = *page;
+}
+
+#if SP_ARENA_STATS && SP_ARENA_THREAD_SAFE
+static uint64_t arena_clock_ns(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000u + (uint64_t)now.tv_nsec;
+}
+#endif
+
+/* Lock helpers, compiled out when thread safety is disabled */
+static inline void arena_lock(sp_arena *arena) {
+#if SP_ARENA_THREAD_SAFE && SP_ARENA_STATS
+    // Only a lock that's already held gets timed 
+    if (arena->config.sync == SP_ARENA_SYNC_NONE || pthread_mutex_trylock(&arena->mutex) == 0) return;
+    uint64_t start = arena_clock_ns();
+    pthread_mutex_lock(&arena->mutex);
+    arena->lock_wait_ns += arena_clock_ns() - start;
+    arena->lock_contentions++;
+#elif SP_ARENA_THREAD_SAFE
+    if (arena->config.sync != SP_ARENA_SYNC_NONE) pthread_mutex_lock(&arena->mutex);
+#else
+    Unused(arena)
+#endif
+}
+
+static inline void arena_unlock(sp_arena *arena) {
+#if SP_ARENA_THREAD_SAFE
+    if (arena->config.sync != SP_ARENA_SYNC_NONE) pthread_mutex_unlock(&arena->mutex);
+#else
+    Unused(arena)
+#endif
+}
+
+/* Invalidate every thread's chunk of the arena, caller must hold the arena lock */
+static inline void arena_bump_epoch(sp_arena *arena) {
+#if SP_ARENA_THREAD_SAFE
+    uint64_t epoch = __atomic_add_fetch(&epoch_counter, 1, __ATOMIC_RELAXED);
+    __atomic_store_n(&arena->epoch, epoch, __ATOMIC_RELEASE);
+#else
+    Unused(arena)
+#endif
+}
+
+/* Blocks are mapped from the OS instead of config.allocator when huge pages or NUMA binding are requested */
+static inline bool arena_os_blocks(const sp_arena *arena) {
+    return arena->config.huge_page_size != 0 || arena->config.numa_policy != SP_ARENA_NUMA_NONE || 
+           arena->config.guard_pages;
+}
+
+/* Inaccessible page mapped after each OS block, huge page mappings can't be split for one */
+static inline size_t arena_guard_size(const sp_arena *arena) {
+    return arena->config.guard_pages && arena->config.huge_page_size == 0 ? arena->page_size : 0;
+}
+
+/* Debug builds poison memory nothing may touch until it's allocated. Under ASan accesses to it 
+ * are reported, without ASan rewound memory is filled with SP_ARENA_POISON_BYTE instead */
+static inline void debug_poison_unused(void *ptr, size_t size) {
+#ifdef SP_ARENA_ASAN
+    ASAN_POISON_MEMORY_REGION(ptr, size);
+#else
+    Unused(ptr)
+    Unused(size)
+#endif
+}
+
+static inline void debug_poison_rewound(void *ptr, size_t size) {
+#ifdef SP_ARENA_ASAN
+    ASAN_POISON_MEMORY_REGION(ptr, size);
+#elif SP_ARENA_DEBUG
+    memset(ptr, SP_ARENA_POISON_BYTE, size);
+#else
+    Unused(ptr)
+    Unused(size)
+#endif
+}
+
+static inline void debug_unpoison(void *ptr, size_t size) {
+#ifdef SP_ARENA_ASAN
+    ASAN_UNPOISON_MEMORY_REGION(ptr, size);
+#else
+    Unused(ptr)
+    Unused(size)
+#endif
+}
+
+/* Map a block's pages from the OS, bound to the arena's NUMA node before they are touched */
+static void *sp_arena_map_block(const sp_arena *arena, size_t size) {
+    size_t guard = arena_guard_size(arena);
+    void *ptr = arena->config.huge_page_size ? os_map_huge(size, arena->config.huge_page_size) 
+                                             : os_map(size + guard, 0, true);
+    if (ptr && arena->config.numa_policy != SP_ARENA_NUMA_NONE) {
+        os_bind_node(ptr, size, arena->config.numa_node);
+    }
+    if (ptr && guard) os_decommit((char *)ptr + size, guard);
+    return ptr;
+}
+
+/* Blocks from the OS are zero filled, allocator blocks only when the allocator says so */
+static inline bool arena_blocks_zeroed(const sp_arena *arena) {
+    return arena_os_blocks(arena) || arena->config.zeroed_allocator;
+}
+
+/* Bytes to allocate for a new block with room for min_size, header included, 0 when it can't fit */
+static size_t arena_block_bytes(sp_arena *arena, size_t min_size) {
+    size_t block_size = arena->next_block_size;
+    size_t request_multiple = arena->config.request_multiple;
+
+    // Fixed sized arenas keep the whole configured size usable
+    if (arena->config.fixed_size) {
+        block_size += SP_ARENA_BLOCK_HEADER_SIZE;
+    }
+
+    // Leave room for several more requests of the same size 
+    if (request_multiple > 1 && min_size <= (SIZE_MAX - SP_ARENA_BLOCK_HEADER_SIZE) / request_multiple) {
+        size_t wanted = min_size * request_multiple + SP_ARENA_BLOCK_HEADER_SIZE;
+        if (wanted > block_size) block_size = wanted;
+    }
+
+    if (arena->config.max_block_size && block_size > arena->config.max_block_size) {
+        block_size = arena->config.max_block_size;
+    }
+
+    // OS backed blocks are always whole (huge) pages 
+    if (arena_os_blocks(arena)) {
+        block_size = align_forward(block_size, arena->page_size);
+    }
 
     // If requested size is larger than the default block_size, 
     // allocate a block big enough to fit it 
-    if (min_size > block_size) {
-        block_size = min_size;
+    if (min_size > block_size - SP_ARENA_BLOCK_HEADER_SIZE) {
+        if (min_size > SIZE_MAX - SP_ARENA_BLOCK_HEADER_SIZE - arena->page_size) return 0;
+        block_size = min_size + SP_ARENA_BLOCK_HEADER_SIZE;
         // Align to multiples of page size 
-        block_size = align_forward(block_size, 4096);
+        block_size = align_forward(block_size, arena->page_size);
     }
+    return block_size;
+}
 
-    void *memory = arena->config.allocator(block_size);
-    if (!memory) {
-        arena->last_err = SP_ARENA_ERR_OUT_OF_MEMORY;
+/* Get memory for a block from the OS or config.allocator, safe to call without the arena lock */
+static sp_arena_block *arena_block_alloc(const sp_arena *arena, size_t block_size) {
+    return arena_os_blocks(arena) ? sp_arena_map_block(arena, block_size) : arena->config.allocator(block_size);
+}
+
+/* Set up the header of freshly allocated block memory and account for it, caller must hold the arena lock */
+static void arena_block_init(sp_arena *arena, sp_arena_block *block, size_t block_size) {
+    block->next = NULL;
+    block->size = block_size - SP_ARENA_BLOCK_HEADER_SIZE;
+    block->used = 0;
+    block->dirty = arena_blocks_zeroed(arena) ? 0 : block->size;
+    block->limit = block->size;
+    debug_poison_unused(sp_arena_block_memory(block), block->size);
+
+    arena->total_allocated += block_size;
+    arena->blocks_created++;
+
+    // Grow the next block geometrically, up to max_block_size 
+    if (arena->config.growth_factor > 1.0) {
+        double next = (double)arena->next_block_size * arena->config.growth_factor;
+        size_t limit = arena->config.max_block_size ? arena->config.max_block_size : SIZE_MAX / 2;
+        arena->next_block_size = next >= (double)limit ? limit : align_forward((size_t)next, arena->page_size);
+    }
+}
+
+/* Create a new block for an arena, the header shares one allocation with the memory region */
+static sp_arena_block* sp_arena_create_block(sp_arena *arena, size_t min_size) {
+    size_t block_size = arena_block_bytes(arena, min_size);
+    if (!block_size) {
+        arena->last_err = SP_ARENA_ERR_ALLOCATION_TOO_LARGE;
         return NULL;
     }
 
-    sp_arena_block *block = arena->config.allocator(sizeof(*block));
+    sp_arena_block *block = arena_block_alloc(arena, block_size);
     if (!block) {
-        arena->config.deallocator(memory);
         arena->last_err = SP_ARENA_ERR_OUT_OF_MEMORY;
         return NULL;
     }
 
-    block->memory = memory;
+    arena_block_init(arena, block, block_size);
+    return block;
+}
+
+/* Return a block to wherever it was allocated from */
+static void sp_arena_free_block(sp_arena *arena, sp_arena_block *block) {
+    debug_unpoison(sp_arena_block_memory(block), block->size);
+    if (arena_os_blocks(arena)) {
+        os_release(block, block->size + SP_ARENA_BLOCK_HEADER_SIZE + arena_guard_size(arena));
+    } else {
+        arena->config.deallocator(block);
+    }
+}
+
+/* Read a block's used offset, which atomic mode bumps without the lock */
+static inline size_t block_load_used(const sp_arena_block *block) {
+#if SP_ARENA_THREAD_SAFE
+    return __atomic_load_n(&block->used, __ATOMIC_RELAXED);
+#else
+    return block->used;
+#endif
+}
+
+/* Whether `size` bytes fit between an offset and a capacity, without wrapping around */
+static inline bool block_fits(size_t offset, size_t size, size_t capacity) {
+    return offset <= capacity && size <= capacity - offset;
+}
+
+/* Move a block's used offset back, remembering how far it was dirtied */
+static inline void block_rewind(sp_arena_block *block, size_t used) {
+    if (block->used > block->dirty) block->dirty = block->used;
+    if (used < block->used) debug_poison_rewound(sp_arena_block_memory(block) + used, block->used - used);
+    block->used = used;
+}
+
+/* Pages given back to the OS read as zero once they are committed again */
+static inline void block_decommitted(sp_arena_block *block, size_t size) {
+    if (block->dirty > size) block->dirty = size;
+}
+
+/* Publish a block's new capacity, readers in atomic mode don't take the lock */
+static inline void block_set_size(sp_arena_block *block, size_t size) {
+#if SP_ARENA_THREAD_SAFE
+    __atomic_store_n(&block->size, size, __ATOMIC_RELEASE);
+#else
+    block->size = size;
+#endif
+}
+
+/* Publish how far the fast path may bump a block before the slow path runs */
+static inline void block_set_limit(sp_arena_block *block, size_t limit) {
+#if SP_ARENA_THREAD_SAFE
+    __atomic_store_n(&block->limit, limit, __ATOMIC_RELEASE);
+#else
+    block->limit = limit;
+#endif
+}
+
+/* Stop the fast path at the prefetch watermark of a block about to serve allocations, 
+ * unless the arena can't grow or already holds a prefetched block. Caller must hold the arena lock */
+static void arena_arm_block(sp_arena *arena, sp_arena_block *block) {
+    size_t limit = block->size;
+    bool grows = arena->reserved ? block->size + SP_ARENA_BLOCK_HEADER_SIZE < arena->reserved 
+                                 : !arena->config.fixed_size && !arena->mapped;
+    if (arena->config.prefetch_watermark > 0.0 && grows && !arena->prefetched) {
+        limit = (size_t)((double)block->size * arena->config.prefetch_watermark);
+    }
+    block_set_limit(block, limit);
+}
+
+/* Reserve the address space of a virtual memory arena and commit its first pages */
+static sp_arena_block* sp_arena_reserve_block(sp_arena *arena) {
+    size_t page_size = arena->page_size;
+    size_t reserve = align_forward(arena->config.reserve_size, page_size);
+    size_t commit = align_forward(arena->config.commit_size, page_size);
+    if (commit > reserve) commit = reserve;
+
+    void *base = os_reserve(reserve, arena->config.huge_page_size);
+    if (!base) {
+        arena->last_err = SP_ARENA_ERR_OUT_OF_MEMORY;
+        return NULL;
+    }
+
+    // Reserved arenas use transparent huge pages, committed pages inherit the binding 
+#if defined(MADV_HUGEPAGE)
+    if (arena->config.huge_page_size) madvise(base, reserve, MADV_HUGEPAGE);
+#endif
+    if (arena->config.numa_policy != SP_ARENA_NUMA_NONE) {
+        os_bind_node(base, reserve, arena->config.numa_node);
+    }
+
+    if (!os_commit(base, commit)) {
+        os_release(base, reserve);
+        arena->last_err = SP_ARENA_ERR_OUT_OF_MEMORY;
+        return NULL;
+    }
+
+    sp_arena_block *block = (sp_arena_block *)base;
     block->next = NULL;
-    block->size = block_size;
+    block->size = commit - SP_ARENA_BLOCK_HEADER_SIZE;
     block->used = 0;
+    block->dirty = 0;
+    block->limit = block->size;
+    debug_poison_unused(sp_arena_block_memory(block), block->size);
 
-    arena->total_allocated += block_size;
-
+    arena->config.commit_size = commit;
+    arena->reserved = reserve;
+    arena->total_allocated = commit;
     return block;
 }
 
+/* Commit enough pages of a virtual memory arena to hold `end` bytes, caller must hold the arena lock */
+static bool sp_arena_commit(sp_arena *arena, sp_arena_block *block, size_t end) {
+    if (end <= block->size) return true;
+
+    size_t committed = block->size + SP_ARENA_BLOCK_HEADER_SIZE;
+    if (end > arena->reserved - SP_ARENA_BLOCK_HEADER_SIZE) {
+        arena->last_err = SP_ARENA_ERR_OUT_OF_MEMORY;
+        return false;
+    }
+
+    size_t target = align_forward(end + SP_ARENA_BLOCK_HEADER_SIZE, arena->config.commit_size);
+    if (target > arena->reserved) target = arena->reserved;
+
+    if (!os_commit((char *)block + committed, target - committed)) {
+        arena->last_err = SP_ARENA_ERR_OUT_OF_MEMORY;
+        return false;
+    }
+
+    // Pages are faulted in before the fast path can reach them 
+    if (arena->config.prefetch_populate) os_populate((char *)block + committed, target - committed, arena->page_size);
+
+    arena->total_allocated += target - committed;
+    debug_poison_unused((char *)block + committed, target - committed);
+    block_set_size(block, target - SP_ARENA_BLOCK_HEADER_SIZE);
+    arena_arm_block(arena, block);
+    return true;
+}
+
+/* The current block passed its watermark, provision what follows it while the fast path still 
+ * has room. Caller must hold the arena lock */
+static void arena_prefetch(sp_arena *arena, sp_arena_block *block) {
+    block_set_limit(block, block->size);
+
+    // Virtual memory arenas commit their next pages ahead instead, which moves the watermark up 
+    if (arena->reserved) {
+        sp_arena_err_t err = arena->last_err;
+        sp_arena_commit(arena, block, block->size + 1);
+        arena->last_err = err;
+        return;
+    }
+
+    // Blocks rewound past or retained by a clear are reused before a new one 
+    if (arena->prefetched || arena->pending || arena->free_mask) return;
+
+#if SP_ARENA_THREAD_SAFE
+    if (arena->prefetch_running) {
+        arena->prefetch_wanted = true;
+        pthread_cond_signal(&arena->prefetch_cond);
+        return;
+    }
+#endif
+
+    size_t block_size = arena_block_bytes(arena, 0);
+    sp_arena_block *prefetched = arena_block_alloc(arena, block_size);
+    if (!prefetched) return;
+    if (arena->config.prefetch_populate) os_populate(prefetched, block_size, arena->page_size);
+    arena_block_init(arena, prefetched, block_size);
+    arena->prefetched = prefetched;
+}
+
+#if SP_ARENA_THREAD_SAFE
+/* Helper thread of config.prefetch_thread, the allocation and its page faults happen here 
+ * without the arena lock held */
+static void *arena_prefetch_main(void *context) {
+    sp_arena *arena = context;
+    pthread_mutex_lock(&arena->mutex);
+    for (;;) {
+        while (!arena->prefetch_wanted && !arena->prefetch_stop) {
+            pthread_cond_wait(&arena->prefetch_cond, &arena->mutex);
+        }
+        if (arena->prefetch_stop) break;
+
+        arena->prefetch_wanted = false;
+        if (arena->prefetched) continue;
+        size_t block_size = arena_block_bytes(arena, 0);
+        pthread_mutex_unlock(&arena->mutex);
+
+        sp_arena_block *block = arena_block_alloc(arena, block_size);
+        if (block && arena->config.prefetch_populate) os_populate(block, block_size, arena->page_size);
+
+        // Only this thread fills arena->prefetched while it runs 
+        pthread_mutex_lock(&arena->mutex);
+        if (block) {
+            arena_block_init(arena, block, block_size);
+            arena->prefetched = block;
+        }
+    }
+    pthread_mutex_unlock(&arena->mutex);
+    return NULL;
+}
+
+/* Stop the helper thread, before the arena lock is taken for the last time */
+static void arena_prefetch_stop(sp_arena *arena) {
+    if (!arena->prefetch_running) return;
+
+    pthread_mutex_lock(&arena->mutex);
+    arena->prefetch_stop = true;
+    pthread_cond_signal(&arena->prefetch_cond);
+    pthread_mutex_unlock(&arena->mutex);
+
+    pthread_join(arena->prefetcher, NULL);
+    pthread_cond_destroy(&arena->prefetch_cond);
+    arena->prefetch_running = false;
+}
+#endif
+
 /* Initialize an arena with the default configuration */
 sp_arena* sp_arena_create(void) {
     return sp_arena_create_with_config(SP_ARENA_DEFAULT_CONFIG);
 }
 
+/* The arena struct is cache line aligned, which plain malloc doesn't guarantee */
+static sp_arena *arena_struct_alloc(void) {
+#if defined(_WIN32)
+    return (sp_arena *)_aligned_malloc(sizeof(sp_arena), SP_ARENA_CACHE_LINE_SIZE);
+#else
+    return (sp_arena *)aligned_alloc(SP_ARENA_CACHE_LINE_SIZE, sizeof(sp_arena));
+#endif
+}
+
+static void arena_struct_free(sp_arena *arena) {
+#if defined(_WIN32)
+    _aligned_free(arena);
+#else
+    free(arena);
+#endif
+}
+
 /* Initialize an arena with a custom configuration */
 sp_arena* sp_arena_create_with_config(sp_arena_config config) {
-    sp_arena* arena = (sp_arena *)malloc(sizeof(*arena));
+    sp_arena* arena = arena_struct_alloc();
     if (!arena) return NULL;
 
     // Validating config 
     if (config.alignment == 0 || !is_power_of_two(config.alignment)) {
-        free(arena);
+        arena_struct_free(arena);
+        return NULL;
+    }
+
+    // Blocks must have room for their header 
+    if (config.reserve_size == 0 && config.block_size <= SP_ARENA_BLOCK_HEADER_SIZE) {
+        arena_struct_free(arena);
         return NULL;
     }
 
-    if (config.block_size == 0) {
-        free(arena);
+    if (config.reserve_size != 0 && config.reserve_size <= SP_ARENA_BLOCK_HEADER_SIZE) {
+        arena_struct_free(arena);
+        return NULL;
+    }
+
+    // Blocks can't be capped below their initial size 
+    if (config.max_block_size != 0 && config.max_block_size < config.block_size) {
+        arena_struct_free(arena);
+        return NULL;
+    }
+
+    // The watermark is a fraction of the block, also rejecting NaN 
+    if (!(config.prefetch_watermark >= 0.0 && config.prefetch_watermark < 1.0)) {
+        arena_struct_free(arena);
         return NULL;
     }
 
     // Custom allocator must come with custom deallocator and vice versa 
     if ((config.allocator != NULL && config.deallocator == NULL) ||
         (config.allocator == NULL && config.deallocator != NULL)) {
-        free(arena);
+        arena_struct_free(arena);
         return NULL;
     }
 
@@ -99,253 +722,1622 @@ sp_arena* sp_arena_create_with_config(sp_arena_config config) {
         config.deallocator = free;
     }
 
+    if (config.thread_chunk_size == 0) {
+        config.thread_chunk_size = SP_ARENA_DEFAULT_THREAD_CHUNK_SIZE;
+    }
+
+    // Whole cache lines per chunk keep threads' chunks from sharing one 
+    config.thread_chunk_size = align_forward(config.thread_chunk_size, SP_ARENA_CACHE_LINE_SIZE);
+
+    if (config.isolate && config.alignment < SP_ARENA_CACHE_LINE_SIZE) {
+        config.alignment = SP_ARENA_CACHE_LINE_SIZE;
+    }
+
+#if !SP_ARENA_THREAD_SAFE
+    // Nothing to synchronise with, report the mode the arena actually runs in 
+    config.sync = SP_ARENA_SYNC_NONE;
+#endif
+
+#if SP_ARENA_DEBUG
+    // Poisoning has to be serialized with the allocations it covers 
+    if (config.sync == SP_ARENA_SYNC_THREAD_CACHE || config.sync == SP_ARENA_SYNC_ATOMIC) {
+        config.sync = SP_ARENA_SYNC_MUTEX;
+    }
+#endif
+
+    if (config.commit_size == 0) {
+        config.commit_size = SP_ARENA_DEFAULT_COMMIT_SIZE;
+    }
+
+    // Huge pages must be a power of two multiple of the regular page size 
+    size_t page_size = os_page_size();
+    if (config.huge_page_size != 0 && 
+        (!is_power_of_two(config.huge_page_size) || config.huge_page_size < page_size)) {
+        arena_struct_free(arena);
+        return NULL;
+    }
+
+    // Bind to the node of the creating thread 
+    if (config.numa_policy == SP_ARENA_NUMA_LOCAL) {
+        config.numa_node = os_current_node();
+    }
+
     memset(arena, 0, sizeof(*arena));
     arena->config = config;
+    arena->page_size = config.huge_page_size ? config.huge_page_size : page_size;
+    arena->next_block_size = config.block_size;
+    arena->min_alignment = config.isolate ? SP_ARENA_CACHE_LINE_SIZE : 1;
 
 #if SP_ARENA_THREAD_SAFE 
     if (pthread_mutex_init(&arena->mutex, NULL) != 0) {
-        free(arena);
+        arena_struct_free(arena);
         return NULL;
     }
 #endif
 
-    // Create first block 
-    sp_arena_block *block = sp_arena_create_block(arena, 0);
+    // Create first block, or the single reserved block of a virtual memory arena 
+    sp_arena_block *block = config.reserve_size ? sp_arena_reserve_block(arena) : sp_arena_create_block(arena, 0);
     if (!block) {
-        free(arena);
-        arena->last_err = SP_ARENA_ERR_OUT_OF_MEMORY;
+#if SP_ARENA_THREAD_SAFE 
+        pthread_mutex_destroy(&arena->mutex);
+#endif
+        arena_struct_free(arena);
         return NULL;
     }
 
     arena->first = block;
     arena->current = block;
+    arena_arm_block(arena, block);
+    arena_bump_epoch(arena);
+
+#if SP_ARENA_THREAD_SAFE 
+    // The helper thread waits on the arena mutex, which unsynchronised arenas never take 
+    if (config.prefetch_thread && config.prefetch_watermark > 0.0 && !arena->reserved && 
+        !config.fixed_size && config.sync != SP_ARENA_SYNC_NONE) {
+        if (pthread_cond_init(&arena->prefetch_cond, NULL) != 0) {
+            sp_arena_free_block(arena, block);
+            pthread_mutex_destroy(&arena->mutex);
+            arena_struct_free(arena);
+            return NULL;
+        }
+        if (pthread_create(&arena->prefetcher, NULL, arena_prefetch_main, arena) != 0) {
+            pthread_cond_destroy(&arena->prefetch_cond);
+            sp_arena_free_block(arena, block);
+            pthread_mutex_destroy(&arena->mutex);
+            arena_struct_free(arena);
+            return NULL;
+        }
+        arena->prefetch_running = true;
+    }
+#endif
     return arena;
 }
 
-static void* sp_arena_alloc_internal(sp_arena* arena, size_t size, size_t alignment) {
-    if (!arena || !arena->current || size == 0) {
-        if (arena) {
-            arena->last_err = size == 0 ? SP_ARENA_ERR_INVALID_SIZE : SP_ARENA_ERR_INVALID_ARENA;
-        }
+/* Snapshot file layout: padding that puts the block header at the page offset it had in the writer, 
+ * so allocations keep their alignment up to the page size, the block header the mapping uses as is, 
+ * the block's used bytes, then a trailer */
+#define SP_ARENA_SNAPSHOT_MAGIC 0x5350415245414E41ULL  /* "SPAREANA" */
+#define SP_ARENA_SNAPSHOT_VERSION 3
+
+typedef struct {
+    uint64_t magic;                 /* SP_ARENA_SNAPSHOT_MAGIC */
+    uint32_t version;               /* SP_ARENA_SNAPSHOT_VERSION */
+    uint32_t header_size;           /* SP_ARENA_BLOCK_HEADER_SIZE of the writer */
+    uint64_t block_offset;          /* File offset of the block header, below the writer's page size */
+} sp_arena_snapshot_trailer;
+
+/* Map a snapshot file back as a read only arena */
+sp_arena* sp_arena_create_from_snapshot(const char *path) {
+#if defined(_WIN32)
+    Unused(path)
+    return NULL;
+#else
+    if (!path) return NULL;
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return NULL;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || 
+        (size_t)st.st_size < SP_ARENA_BLOCK_HEADER_SIZE + sizeof(sp_arena_snapshot_trailer)) {
+        close(fd);
         return NULL;
     }
 
-    if (!is_power_of_two(alignment)) {
-        arena->last_err = SP_ARENA_ERR_INVALID_ALIGNMENT;
+    size_t size = (size_t)st.st_size;
+    void *base = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) return NULL;
+
+    // The trailer isn't necessarily aligned, and the page offset has to survive the mapping 
+    sp_arena_snapshot_trailer trailer;
+    memcpy(&trailer, (char *)base + size - sizeof(trailer), sizeof(trailer));
+    size_t page_size = os_page_size();
+    size_t data_end = size - sizeof(trailer);
+    if (trailer.magic != SP_ARENA_SNAPSHOT_MAGIC || trailer.version != SP_ARENA_SNAPSHOT_VERSION || 
+        trailer.header_size != SP_ARENA_BLOCK_HEADER_SIZE || trailer.block_offset >= page_size || 
+        trailer.block_offset % SP_ARENA_ALIGNOF(sp_arena_block) != 0 || 
+        trailer.block_offset > data_end - SP_ARENA_BLOCK_HEADER_SIZE) {
+        munmap(base, size);
+        return NULL;
+    }
+
+    const sp_arena_block *header = (const sp_arena_block *)((char *)base + trailer.block_offset);
+    if (header->used != data_end - trailer.block_offset - SP_ARENA_BLOCK_HEADER_SIZE || 
+        header->size != header->used || header->limit != header->size) {
+        munmap(base, size);
+        return NULL;
+    }
+
+    // Nothing fits in the mapped block, so every allocation reaches the read only check. The 
+    // mapping is never written, resizes in atomic mode would bump it without the lock 
+    sp_arena_config config = SP_ARENA_DEFAULT_CONFIG;
+    config.fixed_size = true;
+    config.block_size = size;
+#if SP_ARENA_THREAD_SAFE
+    config.sync = SP_ARENA_SYNC_MUTEX;
+#else
+    config.sync = SP_ARENA_SYNC_NONE;
+#endif
+
+    sp_arena *arena = arena_struct_alloc();
+    if (!arena) {
+        munmap(base, size);
         return NULL;
     }
 
+    memset(arena, 0, sizeof(*arena));
+    arena->config = config;
+    arena->page_size = page_size;
+    arena->next_block_size = size;
+    arena->min_alignment = 1;
+    arena->mapped = size;
+
 #if SP_ARENA_THREAD_SAFE 
-    pthread_mutex_lock(&arena->mutex);
-#endif 
+    if (pthread_mutex_init(&arena->mutex, NULL) != 0) {
+        munmap(base, size);
+        arena_struct_free(arena);
+        return NULL;
+    }
+#endif
+
+    arena->first = (sp_arena_block *)header;
+    arena->current = arena->first;
+    arena->total_allocated = size;
+    arena->total_used = header->used;
+    arena_bump_epoch(arena);
+    return arena;
+#endif
+}
+
+#ifdef SP_ARENA_ASAN
+/* Copy memory that may hold redzones byte by byte, ASan neither reports nor unpoisons it */
+__attribute__((no_sanitize_address))
+static void debug_copy_poisoned(char *dst, const volatile char *src, size_t size) {
+    for (size_t i = 0; i < size; i++) dst[i] = src[i];
+}
+#endif
+
+/* Write a block's memory, redzones between allocations included, they stay poisoned */
+static bool snapshot_write_memory(FILE *file, const char *memory, size_t size) {
+#ifdef SP_ARENA_ASAN
+    char buffer[4096];
+    for (size_t done = 0; done < size; ) {
+        size_t chunk = size - done < sizeof(buffer) ? size - done : sizeof(buffer);
+        debug_copy_poisoned(buffer, memory + done, chunk);
+        if (fwrite(buffer, 1, chunk, file) != chunk) return false;
+        done += chunk;
+    }
+    return true;
+#else
+    return fwrite(memory, 1, size, file) == size;
+#endif
+}
+
+/* Write the used bytes of a contiguous arena between its block header and a snapshot trailer */
+bool sp_arena_snapshot_write(sp_arena *arena, const char *path) {
+    if (!arena) return false;
+    if (!path) {
+        arena->last_err = SP_ARENA_ERR_SNAPSHOT;
+        return false;
+    }
+
+    arena_lock(arena);
+    sp_arena_block *block = arena->first;
+    if (!block || block->next || arena->large) {
+        arena->last_err = SP_ARENA_ERR_INVALID_ARENA;
+        arena_unlock(arena);
+        return false;
+    }
+
+    char header[SP_ARENA_BLOCK_HEADER_SIZE];
+    sp_arena_block snapshot;
+    memset(header, 0, sizeof(header));
+    memset(&snapshot, 0, sizeof(snapshot));
+    snapshot.size = block_load_used(block);
+    snapshot.used = snapshot.size;
+    snapshot.dirty = snapshot.size;
+    snapshot.limit = snapshot.size;
+    memcpy(header, &snapshot, sizeof(snapshot));
+
+    // Mappings start on a page, the padding keeps the block at its page offset 
+    sp_arena_snapshot_trailer trailer;
+    memset(&trailer, 0, sizeof(trailer));
+    trailer.magic = SP_ARENA_SNAPSHOT_MAGIC;
+    trailer.version = SP_ARENA_SNAPSHOT_VERSION;
+    trailer.header_size = SP_ARENA_BLOCK_HEADER_SIZE;
+    trailer.block_offset = (uintptr_t)block & (os_page_size() - 1);
+
+    FILE *file = fopen(path, "wb");
+    bool ok = file != NULL;
+    for (uint64_t pad = 0; ok && pad < trailer.block_offset; pad++) ok = fputc(0, file) != EOF;
+    ok = ok && fwrite(header, 1, sizeof(header), file) == sizeof(header) && 
+         snapshot_write_memory(file, sp_arena_block_memory(block), snapshot.used) && 
+         fwrite(&trailer, 1, sizeof(trailer), file) == sizeof(trailer);
+    if (file && fclose(file) != 0) ok = false;
+    if (!ok) arena->last_err = SP_ARENA_ERR_SNAPSHOT;
+
+    arena_unlock(arena);
+    return ok;
+}
+
+/* Offsets count from the first block's header, so offset 0 never points at data */
+size_t sp_arena_offset_of(const sp_arena *arena, const void *ptr) {
+    if (!arena || !ptr) return 0;
+    return (size_t)((const char *)ptr - (const char *)arena->first);
+}
+
+void *sp_arena_ptr_at(const sp_arena *arena, size_t offset) {
+    if (!arena || offset == 0) return NULL;
+    return (char *)arena->first + offset;
+}
+
+/* Map the arena and its only block into memory that forked processes keep sharing */
+sp_arena* sp_arena_create_shared(sp_arena_config config) {
+#if defined(_WIN32)
+    Unused(config)
+    return NULL;
+#else
+    // Thread caches are per process and would be duplicated by fork, other growth needs private memory 
+    if (config.alignment == 0 || !is_power_of_two(config.alignment) || config.block_size == 0 || 
+        config.sync == SP_ARENA_SYNC_THREAD_CACHE || config.reserve_size != 0 || config.huge_page_size != 0) {
+        return NULL;
+    }
+
+#if !SP_ARENA_THREAD_SAFE
+    // There is no lock to share between the processes, they'd allocate unsynchronised 
+    if (config.sync != SP_ARENA_SYNC_NONE) return NULL;
+#endif
+
+    size_t struct_size = align_forward(sizeof(sp_arena), SP_ARENA_CACHE_LINE_SIZE);
+    size_t page_size = os_page_size();
+    if (config.block_size > SIZE_MAX - struct_size - SP_ARENA_BLOCK_HEADER_SIZE - page_size) return NULL;
+    size_t size = align_forward(struct_size + SP_ARENA_BLOCK_HEADER_SIZE + config.block_size, page_size);
+
+    void *base = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (base == MAP_FAILED) return NULL;
+
+    if (config.isolate && config.alignment < SP_ARENA_CACHE_LINE_SIZE) {
+        config.alignment = SP_ARENA_CACHE_LINE_SIZE;
+    }
+
+#if SP_ARENA_DEBUG
+    if (config.sync == SP_ARENA_SYNC_ATOMIC) config.sync = SP_ARENA_SYNC_MUTEX;
+#endif
+
+    // Large allocations and new blocks would come from one process's heap 
+    config.fixed_size = true;
+    config.allocator = NULL;
+    config.deallocator = NULL;
+    config.numa_policy = SP_ARENA_NUMA_NONE;
+    config.zeroed_allocator = true;
+
+    sp_arena *arena = (sp_arena *)base;
+    arena->config = config;
+    arena->page_size = page_size;
+    arena->next_block_size = config.block_size;
+    arena->min_alignment = config.isolate ? SP_ARENA_CACHE_LINE_SIZE : 1;
+    arena->shared = size;
+
+#if SP_ARENA_THREAD_SAFE 
+    pthread_mutexattr_t attr;
+    bool locked = pthread_mutexattr_init(&attr) == 0;
+    if (locked) {
+        locked = pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED) == 0 && 
+                 pthread_mutex_init(&arena->mutex, &attr) == 0;
+        pthread_mutexattr_destroy(&attr);
+    }
+
+    if (!locked) {
+        munmap(base, size);
+        return NULL;
+    }
+#endif
+
+    // Fresh shared pages are zero, the block header follows the arena struct. It isn't poisoned 
+    // for debug builds since ASan's shadow memory is private to each process 
+    sp_arena_block *block = (sp_arena_block *)((char *)base + struct_size);
+    block->size = size - struct_size - SP_ARENA_BLOCK_HEADER_SIZE;
+    block->limit = block->size;
+
+    arena->first = block;
+    arena->current = block;
+    arena->total_allocated = size;
+    arena_bump_epoch(arena);
+    return arena;
+#endif
+}
+
+/* Publish the block allocations are served from, readers in atomic mode don't take the lock. 
+ * Its watermark is armed first so they never bump past it */
+static inline void arena_set_current(sp_arena *arena, sp_arena_block *block) {
+    arena_arm_block(arena, block);
+#if SP_ARENA_THREAD_SAFE
+    __atomic_store_n(&arena->current, block, __ATOMIC_RELEASE);
+#else
+    arena->current = block;
+#endif
+}
+
+/* Keep an emptied block in the free bin for its size class, caller must hold the arena lock */
+static void arena_bin_push(sp_arena *arena, sp_arena_block *block) {
+    size_t bin = log2_size(block->size);
+    block_rewind(block, 0);
+    block->idle_clears = 0;
+    block->next = arena->free_bins[bin];
+    arena->free_bins[bin] = block;
+    arena->free_mask |= (uint64_t)1 << bin;
+}
+
+static sp_arena_block *arena_bin_pop(sp_arena *arena, size_t bin) {
+    sp_arena_block *block = arena->free_bins[bin];
+    arena->free_bins[bin] = block->next;
+    if (!block->next) arena->free_mask &= ~((uint64_t)1 << bin);
+    block->next = NULL;
+    return block;
+}
+
+/* Take a free block with room for the request in constant time, caller must hold the arena lock */
+static sp_arena_block *arena_bin_take(sp_arena *arena, size_t size, size_t alignment) {
+    if (!arena->free_mask || size > SIZE_MAX - alignment) return NULL;
+
+    // Blocks in the request's own bin may be too small, only its head is checked 
+    size_t bin = log2_size(size + alignment - 1);
+    sp_arena_block *head = arena->free_bins[bin];
+    if (head && align_offset(head, 0, alignment) + size <= head->size) {
+        return arena_bin_pop(arena, bin);
+    }
+
+    // Every block in a higher bin fits, take the smallest one 
+    if (bin + 1 >= SP_ARENA_FREE_BINS) return NULL;
+    uint64_t larger = arena->free_mask & ~(((uint64_t)2 << bin) - 1);
+    if (!larger) return NULL;
+    return arena_bin_pop(arena, lowest_bit(larger));
+}
+
+/* Detach every block after `block` in the chain onto the pending list in constant time. 
+ * The chain ends at arena->current, so call this before moving current back, 
+ * caller must hold the arena lock */
+static void arena_release_after(sp_arena *arena, sp_arena_block *block) {
+    sp_arena_block *next = block->next;
+    if (!next) return;
+
+    block->next = NULL;
+    arena->current->next = arena->pending;
+    arena->pending = next;
+
+#if SP_ARENA_DEBUG
+    // Pending blocks keep their used offset until they are reused, their contents are dead now 
+    for (sp_arena_block *dead = next; ; dead = dead->next) {
+        debug_poison_rewound(sp_arena_block_memory(dead), dead->used);
+        if (dead == arena->current) break;
+    }
+#endif
+}
+
+/* Move the pending blocks to the free bins, caller must hold the arena lock */
+static void arena_drain_pending(sp_arena *arena) {
+    sp_arena_block *block = arena->pending;
+    arena->pending = NULL;
+    while (block) {
+        sp_arena_block *next = block->next;
+        arena_bin_push(arena, block);
+        block = next;
+    }
+}
+
+/* Reuse the pending block rewound most recently when the request fits its start, 
+ * caller must hold the arena lock */
+static sp_arena_block *arena_pending_take(sp_arena *arena, size_t size, size_t alignment) {
+    sp_arena_block *block = arena->pending;
+    if (!block || align_offset(block, 0, alignment) + size > block->size) return NULL;
+
+    arena->pending = block->next;
+    block_rewind(block, 0);
+    block->next = NULL;
+    return block;
+}
+
+/* Remember total_used before it's lowered or after it grew in place, safe without the lock 
+ * since atomic mode resizes don't take it */
+static inline void arena_note_peak(sp_arena *arena) {
+    size_t used = __atomic_load_n(&arena->total_used, __ATOMIC_RELAXED);
+    size_t peak = __atomic_load_n(&arena->peak_used, __ATOMIC_RELAXED);
+    while (used > peak && !__atomic_compare_exchange_n(&arena->peak_used, &peak, used, true, 
+                                                       __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+    }
+}
+
+/* Account used bytes, atomic mode updates total_used without the lock */
+static inline void arena_add_used(sp_arena *arena, size_t size) {
+#if SP_ARENA_THREAD_SAFE
+    if (arena->config.sync == SP_ARENA_SYNC_ATOMIC) {
+        __atomic_fetch_add(&arena->total_used, size, __ATOMIC_RELAXED);
+        return;
+    }
+#endif
+    arena->total_used += size;
+}
+
+/* Requests that don't fit the current block and are this large get their own allocation */
+static inline bool sp_arena_is_large(const sp_arena *arena, size_t size) {
+    if (arena->reserved || arena->config.fixed_size) return false;
+
+    size_t threshold = arena->config.large_threshold;
+    if (threshold == 0) threshold = arena->next_block_size - SP_ARENA_BLOCK_HEADER_SIZE + 1;
+    return size >= threshold;
+}
+
+/* Give a large allocation its own block on the large list, leaving the current block alone */
+static void* sp_arena_alloc_large(sp_arena* arena, size_t size, size_t alignment) {
+    if (size > SIZE_MAX - SP_ARENA_BLOCK_HEADER_SIZE - alignment - arena->page_size) {
+        arena->last_err = SP_ARENA_ERR_ALLOCATION_TOO_LARGE;
+        return NULL;
+    }
+
+    // Arenas retaining large blocks serve them again from the free bins 
+    sp_arena_block *block = NULL;
+    if (arena->config.retain_large) {
+        arena_drain_pending(arena);
+        block = arena_bin_take(arena, size, alignment);
+    }
 
+    if (!block) {
+        size_t block_size = align_forward(size + alignment - 1 + SP_ARENA_BLOCK_HEADER_SIZE, arena->page_size);
+        block = arena_block_alloc(arena, block_size);
+        if (!block) {
+            arena->last_err = SP_ARENA_ERR_OUT_OF_MEMORY;
+            return NULL;
+        }
+        block->size = block_size - SP_ARENA_BLOCK_HEADER_SIZE;
+        block->dirty = arena_blocks_zeroed(arena) ? 0 : block->size;
+        block->limit = block->size;
+        arena->total_allocated += block_size;
+        arena->blocks_created++;
+    }
+
+    block->used = block->size;
+    block->next = arena->large;
+    arena->large = block;
+
+    arena_add_used(arena, size);
+    sp_arena_count_alloc(arena, 0);
+
+    char *result = align_forward_ptr(sp_arena_block_memory(block), alignment);
+    debug_poison_unused(sp_arena_block_memory(block), block->size);
+    debug_unpoison(result, size);
+    return result;
+}
+
+/* Free large allocations made after `until`, newest first, or keep them in the free bins 
+ * when `retain` is set, caller must hold the arena lock */
+static void sp_arena_free_large(sp_arena *arena, sp_arena_block *until, bool retain) {
+    while (arena->large && arena->large != until) {
+        sp_arena_block *block = arena->large;
+        arena->large = block->next;
+        if (retain) {
+            arena_bin_push(arena, block);
+            continue;
+        }
+        arena->total_allocated -= block->size + SP_ARENA_BLOCK_HEADER_SIZE;
+        sp_arena_free_block(arena, block);
+    }
+}
+
+/* Move to a block with room for the request, caller must hold the arena lock */
+static sp_arena_block* sp_arena_next_block(sp_arena* arena, size_t size, size_t alignment) {
     sp_arena_block *block = arena->current;
 
-    // Align current used position 
-    size_t aligned_used = align_forward(block->used, alignment);  // 3, 8 -> 8  
-    size_t padding = aligned_used - block->used;                  // p -> 8 - 3 = 5
-    size_t req_size = size + padding;                             // 2 + 5 = 7 
-                                                                  // 8 + 2 = 10 < 64 
-    // Check if there's enough space in current block
-    if (aligned_used + size <= block->size) {
-        // Have space in current block
-        void* result = (char*)block->memory + aligned_used;
-        block->used = aligned_used + size;
-        arena->total_used += req_size;
-        
-    #if SP_ARENA_THREAD_SAFE
-        pthread_mutex_unlock(&arena->mutex);
-    #endif
-        return result;
+    // Virtual memory arenas never leave their block, they commit more of it instead
+    if (arena->reserved) {
+        size_t aligned_used = align_offset(block, block_load_used(block), alignment);
+        if (block_fits(aligned_used, size, block->size)) return block;
+        if (size > SIZE_MAX - aligned_used) {
+            arena->last_err = SP_ARENA_ERR_ALLOCATION_TOO_LARGE;
+            return NULL;
+        }
+        return sp_arena_commit(arena, block, aligned_used + size) ? block : NULL;
     }
-    
-    // Not enough space in current block
+
+    if (arena->mapped) {
+        arena->last_err = SP_ARENA_ERR_READ_ONLY;
+        return NULL;
+    }
+
     if (arena->config.fixed_size) {
         // Fixed sized arena cannot create more blocks
         arena->last_err = SP_ARENA_ERR_OUT_OF_MEMORY;
-    #if SP_ARENA_THREAD_SAFE 
-        pthread_mutex_unlock(&arena->mutex);
-    #endif 
         return NULL;
     }
-    
-    // Look for an existing next block with enough space if not fixed arena 
-    sp_arena_block* next_block = block->next;
-    while (next_block != NULL) {
-        aligned_used = align_forward(next_block->used, alignment);
-        padding = aligned_used - next_block->used;
-        
-        if (aligned_used + size <= next_block->size) {
-            // Found a suitable existing block
-            arena->current = next_block;
-            void* result = (char*)next_block->memory + aligned_used;
-            next_block->used = aligned_used + size;
-            arena->total_used += size + padding;
-            
-        #if SP_ARENA_THREAD_SAFE
-            pthread_mutex_unlock(&arena->mutex);
-        #endif
-            return result;
-        }
-        
-        // Reset this block since we're skipping past it
-        next_block->used = 0;
-        next_block = next_block->next;
+
+    if (size > SIZE_MAX - alignment) {
+        arena->last_err = SP_ARENA_ERR_ALLOCATION_TOO_LARGE;
+        return NULL;
     }
     
-    // If not existing block found then need to create a new block
-    sp_arena_block* new_block = sp_arena_create_block(arena, size);
+    // Reuse the block a temp scope just rewound past, then a retained block from the 
+    // free bins or the prefetched one, otherwise create a new one with room to align the request 
+    sp_arena_block* new_block = arena_pending_take(arena, size, alignment);
     if (!new_block) {
-        arena->last_err = SP_ARENA_ERR_OUT_OF_MEMORY;
-    #if SP_ARENA_THREAD_SAFE
-        pthread_mutex_unlock(&arena->mutex);
-    #endif
-        return NULL;
+        arena_drain_pending(arena);
+        new_block = arena_bin_take(arena, size, alignment);
     }
+    sp_arena_block *prefetched = arena->prefetched;
+    if (!new_block && prefetched && align_offset(prefetched, 0, alignment) + size <= prefetched->size) {
+        new_block = prefetched;
+        arena->prefetched = NULL;
+    }
+    if (!new_block) new_block = sp_arena_create_block(arena, size + alignment - 1);
+    if (!new_block) return NULL;
     
-    // Link the new block
-    new_block->next = block->next;
+    // Whatever the old block couldn't fit is lost until the next clear or rewind 
+    arena->tail_waste += block->size - block_load_used(block);
+
+    // Link the new block before it becomes visible to other threads
     block->next = new_block;
-    arena->current = new_block;
-    
-    // Allocate from the new block
-    void* result = new_block->memory; // No alignment needed for fresh block
-    new_block->used = size;
-    arena->total_used += size;
-    
-#if SP_ARENA_THREAD_SAFE
-    pthread_mutex_unlock(&arena->mutex);
+    arena_set_current(arena, new_block);
+    return new_block;
+}
+
+/* Bump allocate from the block chain, caller must hold the arena lock */
+static void* sp_arena_alloc_nolock(sp_arena* arena, size_t size, size_t alignment) {
+    sp_arena_block *block = arena->current;
+    if (!block) {
+        arena->last_err = SP_ARENA_ERR_INVALID_ARENA;
+        return NULL;
+    }
+
+    // Debug builds leave a poisoned redzone after every allocation 
+    size_t reserve = size;
+#if SP_ARENA_DEBUG
+    if (size > SIZE_MAX - SP_ARENA_DEBUG_REDZONE) {
+        arena->last_err = SP_ARENA_ERR_ALLOCATION_TOO_LARGE;
+        return NULL;
+    }
+    reserve += SP_ARENA_DEBUG_REDZONE;
+#endif
+
+    // Align current used position 
+    size_t aligned_used = align_offset(block, block->used, alignment);  // 3, 8 -> 8  
+                                                                  // 8 + 2 = 10 < 64 
+    // Passed the prefetch watermark 
+    if (!block_fits(aligned_used, reserve, block->limit) && block->limit < block->size) arena_prefetch(arena, block);
+
+    // Not enough space in current block
+    if (!block_fits(aligned_used, reserve, block->size)) {
+        if (sp_arena_is_large(arena, size)) return sp_arena_alloc_large(arena, size, alignment);
+
+        block = sp_arena_next_block(arena, reserve, alignment);
+        if (!block) return NULL;
+        aligned_used = align_offset(block, block->used, alignment);
+    }
+
+    size_t padding = aligned_used - block->used;                  // p -> 8 - 3 = 5
+    size_t req_size = reserve + padding;                          // 2 + 5 = 7 
+    sp_arena_count_alloc(arena, padding);
+
+    void* result = sp_arena_block_memory(block) + aligned_used;
+    block->used = aligned_used + reserve;
+    arena->total_used += req_size;
+    debug_unpoison(result, size);
+    return result;
+}
+
+#if SP_ARENA_THREAD_SAFE 
+/* Lock-free bump of block->used, the arena lock is only taken to publish a new block 
+ * unless the caller already holds it (`locked`) */
+static void* sp_arena_alloc_atomic(sp_arena* arena, size_t size, size_t alignment, bool locked) {
+    sp_arena_block *block = __atomic_load_n(&arena->current, __ATOMIC_ACQUIRE);
+    while (block) {
+        size_t used = __atomic_load_n(&block->used, __ATOMIC_RELAXED);
+        size_t capacity = __atomic_load_n(&block->size, __ATOMIC_ACQUIRE);
+        size_t aligned_used = align_offset(block, used, alignment);
+
+        // Passed the prefetch watermark, the first thread through the lock disarms it 
+        size_t limit = __atomic_load_n(&block->limit, __ATOMIC_ACQUIRE);
+        if (!block_fits(aligned_used, size, limit) && limit < capacity) {
+            if (!locked) arena_lock(arena);
+            if (arena->current == block && block->limit < block->size) arena_prefetch(arena, block);
+            if (!locked) arena_unlock(arena);
+            capacity = __atomic_load_n(&block->size, __ATOMIC_ACQUIRE);
+        }
+        while (block_fits(aligned_used, size, capacity)) {
+            if (__atomic_compare_exchange_n(&block->used, &used, aligned_used + size, true,
+                                            __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                __atomic_fetch_add(&arena->total_used, aligned_used + size - used, __ATOMIC_RELAXED);
+                sp_arena_count_alloc(arena, aligned_used - used);
+                return sp_arena_block_memory(block) + aligned_used;
+            }
+            // Lost the race, `used` now holds the winner's value
+            aligned_used = align_offset(block, used, alignment);
+        }
+
+        // Block is full, one thread moves to the next block while the others wait and retry on it
+        if (!locked) arena_lock(arena);
+        sp_arena_block *current = arena->current;
+        if (current == block && sp_arena_is_large(arena, size)) {
+            void *result = sp_arena_alloc_large(arena, size, alignment);
+            if (!locked) arena_unlock(arena);
+            return result;
+        }
+        if (current == block) {
+            current = sp_arena_next_block(arena, size, alignment);
+        }
+        if (!locked) arena_unlock(arena);
+        block = current;
+    }
+    return NULL;
+}
+
+/* Pick the slot to refill: the arena's stale slot, an empty slot, or round robin */
+static inline sp_arena_thread_chunk *thread_chunk_slot(const sp_arena *arena) {
+    for (size_t i = 0; i < SP_ARENA_THREAD_CHUNK_SLOTS; i++) {
+        sp_arena_thread_chunk *chunk = &sp_arena_thread_chunks[i];
+        if (chunk->arena == arena || chunk->epoch == 0) return chunk;
+    }
+    thread_chunk_victim = (thread_chunk_victim + 1) % SP_ARENA_THREAD_CHUNK_SLOTS;
+    return &sp_arena_thread_chunks[thread_chunk_victim];
+}
+
+/* Bump allocate from the calling thread's chunk, the arena lock is only taken on refill */
+static void* sp_arena_alloc_thread_cached(sp_arena* arena, size_t size, size_t alignment) {
+    uint64_t epoch = __atomic_load_n(&arena->epoch, __ATOMIC_ACQUIRE);
+    sp_arena_thread_chunk *chunk = sp_arena_thread_chunk_find(epoch);
+    if (chunk) {
+        char *aligned = align_forward_ptr(chunk->cursor, alignment);
+        if (aligned <= chunk->end && (size_t)(chunk->end - aligned) >= size) {
+            sp_arena_count_alloc(arena, (size_t)(aligned - chunk->cursor));
+            chunk->cursor = aligned + size;
+            return aligned;
+        }
+    }
+
+    size_t chunk_size = arena->config.thread_chunk_size;
+
+    arena_lock(arena);
+
+    // Requests that would waste most of a chunk go straight to the shared block
+    if (size >= chunk_size / 2 || size + alignment > chunk_size / 2) {
+        void *result = sp_arena_alloc_nolock(arena, size, alignment);
+        arena_unlock(arena);
+        return result;
+    }
+
+    // Carve a fresh chunk on its own cache lines, taking whatever is left of the current block if it fits
+    size_t chunk_alignment = alignment > SP_ARENA_CACHE_LINE_SIZE ? alignment : SP_ARENA_CACHE_LINE_SIZE;
+    sp_arena_block *block = arena->current;
+    size_t aligned_used = align_offset(block, block->used, chunk_alignment);
+    if (block_fits(aligned_used, size, block->size) && !block_fits(aligned_used, chunk_size, block->size)) {
+        chunk_size = block->size - aligned_used;
+    }
+
+    char *memory = sp_arena_alloc_nolock(arena, chunk_size, chunk_alignment);
+    if (!memory) {
+        arena_unlock(arena);
+        return NULL;
+    }
+
+    chunk = thread_chunk_slot(arena);
+    chunk->arena = arena;
+    chunk->epoch = arena->epoch;
+    chunk->cursor = memory + size;
+    chunk->end = memory + chunk_size;
+
+    arena_unlock(arena);
+    return memory;
+}
+#endif
+
+/* Take the arena lock for a run of _unlocked calls */
+void sp_arena_lock(sp_arena *arena) {
+    if (arena) arena_lock(arena);
+}
+
+void sp_arena_unlock(sp_arena *arena) {
+    if (arena) arena_unlock(arena);
+}
+
+/* Allocate while the caller holds the arena lock */
+void *sp_arena_alloc_aligned_unlocked(sp_arena *arena, size_t size, size_t alignment) {
+    if (!arena || size == 0) {
+        if (arena) arena->last_err = SP_ARENA_ERR_INVALID_SIZE;
+        return NULL;
+    }
+
+    if (!is_power_of_two(alignment)) {
+        arena->last_err = SP_ARENA_ERR_INVALID_ALIGNMENT;
+        return NULL;
+    }
+    if (alignment < arena->min_alignment) alignment = arena->min_alignment;
+
+#if SP_ARENA_THREAD_SAFE 
+    // Other threads keep bumping lock-free, so the shared block still needs the CAS 
+    if (arena->config.sync == SP_ARENA_SYNC_ATOMIC) {
+        return sp_arena_alloc_atomic(arena, size, alignment, true);
+    }
+#endif
+    return sp_arena_alloc_nolock(arena, size, alignment);
+}
+
+void *sp_arena_alloc_unlocked(sp_arena *arena, size_t size) {
+    return sp_arena_alloc_aligned_unlocked(arena, size, arena ? arena->config.alignment : 1);
+}
+
+/* Allocation slow path behind the inline fast path in sp_arena.h */
+void* sp_arena_alloc_slow(sp_arena* arena, size_t size, size_t alignment) {
+    if (!arena || size == 0) {
+        if (arena) {
+            arena->last_err = size == 0 ? SP_ARENA_ERR_INVALID_SIZE : SP_ARENA_ERR_INVALID_ARENA;
+        }
+        return NULL;
+    }
+
+    if (!is_power_of_two(alignment)) {
+        arena->last_err = SP_ARENA_ERR_INVALID_ALIGNMENT;
+        return NULL;
+    }
+    if (alignment < arena->min_alignment) alignment = arena->min_alignment;
+
+#if SP_ARENA_THREAD_SAFE 
+    if (arena->config.sync == SP_ARENA_SYNC_ATOMIC) {
+        return sp_arena_alloc_atomic(arena, size, alignment, false);
+    }
+    if (arena->config.sync == SP_ARENA_SYNC_THREAD_CACHE) {
+        return sp_arena_alloc_thread_cached(arena, size, alignment);
+    }
 #endif
 
+    arena_lock(arena);
+    void *result = sp_arena_alloc_nolock(arena, size, alignment);
+    arena_unlock(arena);
     return result;
 }
 
-/* Allocate memory from an arena */
-void *sp_arena_alloc(sp_arena *arena, size_t size) {
-    return sp_arena_alloc_internal(arena, size, arena->config.alignment);
-}   
+/* Lay pieces of `length` times their size out in one allocation aligned to the largest 
+ * piece alignment, so every offset aligned within it is aligned in memory */
+static void *arena_alloc_pieces(sp_arena *arena, size_t length, const size_t *sizes, const size_t *aligns, 
+                                bool natural, void **out, size_t count) {
+    if (!arena) return NULL;
+    if (!sizes || !out || count == 0) {
+        arena->last_err = SP_ARENA_ERR_INVALID_SIZE;
+        return NULL;
+    }
+
+    size_t total = 0;
+    size_t max_align = 1;
+    for (size_t i = 0; i < count; i++) {
+        size_t align = aligns ? aligns[i] : natural ? (sizes[i] & (~sizes[i] + 1)) : arena->config.alignment;
+        if (align == 0 && !aligns) align = 1;
+        if (!is_power_of_two(align)) {
+            arena->last_err = SP_ARENA_ERR_INVALID_ALIGNMENT;
+            return NULL;
+        }
+        if (length && sizes[i] > SIZE_MAX / length) {
+            arena->last_err = SP_ARENA_ERR_ALLOCATION_TOO_LARGE;
+            return NULL;
+        }
+
+        size_t offset = (total + align - 1) & ~(align - 1);
+        if (offset < total || sizes[i] * length > SIZE_MAX - offset) {
+            arena->last_err = SP_ARENA_ERR_ALLOCATION_TOO_LARGE;
+            return NULL;
+        }
+        out[i] = (void *)offset;
+        total = offset + sizes[i] * length;
+        if (align > max_align) max_align = align;
+    }
+
+    char *base = sp_arena_alloc_aligned(arena, total, max_align);
+    if (!base) return NULL;
+
+    for (size_t i = 0; i < count; i++) out[i] = base + (uintptr_t)out[i];
+    return base;
+}
+
+/* Allocate several pieces with one lock and one bound check */
+void *sp_arena_alloc_batch(sp_arena *arena, const size_t *sizes, const size_t *aligns, void **out, size_t count) {
+    return arena_alloc_pieces(arena, 1, sizes, aligns, false, out, count);
+}
+
+/* Allocate a struct of arrays in one allocation */
+void *sp_arena_alloc_soa(sp_arena *arena, size_t length, const size_t *elem_sizes, const size_t *elem_aligns, 
+                         void **out, size_t count) {
+    return arena_alloc_pieces(arena, length, elem_sizes, elem_aligns, true, out, count);
+}
+
+/* Bytes of a fresh allocation that may hold old data, caller must hold the arena lock */
+static size_t arena_dirty_bytes(const sp_arena *arena, const char *ptr, size_t size) {
+    const sp_arena_block *blocks[2] = { arena->current, arena->large };
+    for (size_t i = 0; i < 2; i++) {
+        const sp_arena_block *block = blocks[i];
+        if (!block) continue;
+
+        const char *memory = sp_arena_block_memory(block);
+        if (ptr < memory || ptr >= memory + block->size) continue;
 
-/* Allocate aligned memory from an arena */
-void *sp_arena_alloc_aligned(sp_arena *arena, size_t size, size_t alignment) {
-    return sp_arena_alloc_internal(arena, size, alignment);
+        const char *dirty_end = memory + block->dirty;
+        if (ptr >= dirty_end) return 0;
+        return (size_t)(dirty_end - ptr) < size ? (size_t)(dirty_end - ptr) : size;
+    }
+    return size;
 }
 
-/* Allocate zero-initialized memory from an arena */
+/* Allocate zero-initialized memory from an arena, clearing only bytes that were dirtied before */
 void *sp_arena_calloc(sp_arena *arena, size_t size) {
-    void *result = sp_arena_alloc(arena, size);
-    if (result) memset(result, 0, size);
+    if (!arena || size == 0) return sp_arena_alloc_slow(arena, size, 1);
+
+#if SP_ARENA_THREAD_SAFE
+    // Lock-free allocations don't tell which block they came from 
+    if (arena->config.sync == SP_ARENA_SYNC_THREAD_CACHE || arena->config.sync == SP_ARENA_SYNC_ATOMIC) {
+        void *result = sp_arena_alloc(arena, size);
+        if (result) memset(result, 0, size);
+        return result;
+    }
+#endif
+
+    arena_lock(arena);
+    void *result = sp_arena_alloc_nolock(arena, size, arena->config.alignment);
+    size_t dirty = result ? arena_dirty_bytes(arena, result, size) : 0;
+    arena_unlock(arena);
+
+    if (dirty) memset(result, 0, dirty);
+    return result;
+}
+
+#if SP_ARENA_THREAD_SAFE
+/* Grow or shrink in place with a CAS on the current block's used offset, `locked` when 
+ * the caller already holds the arena lock */
+static void *arena_resize_atomic(sp_arena *arena, void *old_ptr, size_t old_size, size_t new_size, 
+                                 size_t alignment, bool locked) {
+    sp_arena_block *block = __atomic_load_n(&arena->current, __ATOMIC_ACQUIRE);
+    uintptr_t memory = (uintptr_t)sp_arena_block_memory(block);
+    uintptr_t ptr = (uintptr_t)old_ptr;
+    for (int attempt = 0; attempt < 2 && ptr >= memory; attempt++) {
+        size_t expected = ptr - memory + old_size;
+        if (ptr - memory + new_size <= __atomic_load_n(&block->size, __ATOMIC_ACQUIRE)) {
+            if (__atomic_compare_exchange_n(&block->used, &expected, ptr - memory + new_size, false,
+                                            __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                if (new_size < old_size) arena_note_peak(arena);
+                __atomic_fetch_add(&arena->total_used, new_size - old_size, __ATOMIC_RELAXED);
+                if (new_size > old_size) arena_note_peak(arena);
+                return old_ptr;
+            }
+            break;
+        }
+
+        // Virtual memory arenas commit more pages so the last allocation keeps growing in place
+        if (!arena->reserved || block_load_used(block) != expected) break;
+        if (!locked) arena_lock(arena);
+        bool committed = sp_arena_commit(arena, block, ptr - memory + new_size);
+        if (!locked) arena_unlock(arena);
+        if (!committed) return NULL;
+    }
+
+    void *new_ptr = sp_arena_alloc_atomic(arena, new_size, alignment, locked);
+    if (new_ptr) memcpy(new_ptr, old_ptr, old_size < new_size ? old_size : new_size);
+    return new_ptr;
+}
+#endif
+
+/* Resize on the block chain, caller must hold the arena lock */
+static void *arena_resize_nolock(sp_arena *arena, void *old_ptr, size_t old_size, size_t new_size, size_t alignment) {
+    sp_arena_block *block = arena->current;
+    if (!block) {
+        arena->last_err = SP_ARENA_ERR_INVALID_ARENA;
+        return NULL;
+    }
+
+    if (arena->mapped) {
+        arena->last_err = SP_ARENA_ERR_READ_ONLY;
+        return NULL;
+    }
+
+    // The newest large allocation owns its block, so it can grow in place or move and free it
+    sp_arena_block *large = arena->large;
+    char *large_memory = large ? sp_arena_block_memory(large) : NULL;
+    if (large && (char*)old_ptr >= large_memory && (char*)old_ptr < large_memory + large->size) {
+        if ((char*)old_ptr + new_size <= large_memory + large->size) {
+            if (new_size < old_size) arena_note_peak(arena);
+            arena->total_used = arena->total_used - old_size + new_size;
+            arena_note_peak(arena);
+            debug_unpoison(old_ptr, new_size);
+            if (new_size < old_size) debug_poison_rewound((char *)old_ptr + new_size, old_size - new_size);
+            return old_ptr;
+        }
+
+        void *new_ptr = sp_arena_alloc_nolock(arena, new_size, alignment);
+        if (new_ptr) {
+            memcpy(new_ptr, old_ptr, old_size);
+            arena_note_peak(arena);
+            arena->total_used -= old_size;
+
+            // Unlink the old block, the new allocation may have been pushed in front of it 
+            sp_arena_block **link = &arena->large;
+            while (*link != large) link = &(*link)->next;
+            *link = large->next;
+            arena->total_allocated -= large->size + SP_ARENA_BLOCK_HEADER_SIZE;
+            sp_arena_free_block(arena, large);
+        }
+
+        return new_ptr;
+    }
+
+    // Check if old_ptr is at the end of the current block
+    char *block_end = sp_arena_block_memory(block) + block->used - old_size;
+    if ((char*)old_ptr != block_end) {
+        // Not the last allocation, need to allocate new memory
+        void *new_ptr = sp_arena_alloc_nolock(arena, new_size, alignment);
+        if (new_ptr) {
+            // Copy old data to new location
+            size_t copy_size = old_size < new_size ? old_size : new_size;
+            memcpy(new_ptr, old_ptr, copy_size);
+        }
+        
+        return new_ptr;
+    }
+    
+    // We can resize in place
+    if (new_size > old_size) {
+        size_t additional = new_size - old_size;
+        if (block->used + additional > block->size && arena->reserved) {
+            // Virtual memory arenas commit more pages and keep growing in place
+            if (!sp_arena_commit(arena, block, block->used + additional)) {
+                return NULL;
+            }
+        } else if (block->used + additional > block->size) {
+            // Not enough space, allocate new memory
+            if (arena->config.fixed_size) {
+                arena->last_err = SP_ARENA_ERR_OUT_OF_MEMORY;
+                return NULL;
+            }
+            
+            void *new_ptr = sp_arena_alloc_nolock(arena, new_size, alignment);
+            if (new_ptr) {
+                // Copy old data
+                memcpy(new_ptr, old_ptr, old_size);
+                // Adjust the old block's used size
+                block_rewind(block, block->used - old_size);
+                arena_note_peak(arena);
+                arena->total_used -= old_size;
+            }
+            
+            return new_ptr;
+        }
+    }
+    
+    // Adjust block size, keeping the peak of a shrink's old size or a growth's new one 
+    block_rewind(block, block->used - old_size + new_size);
+    if (new_size < old_size) arena_note_peak(arena);
+    arena->total_used = arena->total_used - old_size + new_size;
+    arena_note_peak(arena);
+    debug_unpoison(old_ptr, new_size);
+    
+    return old_ptr;
+}
+
+/* Resize an allocation from an arena, moving it to memory with the given alignment if it can't stay */
+void *sp_arena_resize_aligned(sp_arena *arena, void *old_ptr, size_t old_size, size_t new_size, size_t alignment) {
+    if (!arena || !old_ptr || old_size == 0 || new_size == 0) {
+        if (arena) arena->last_err = SP_ARENA_ERR_INVALID_SIZE;
+        return NULL;
+    }
+
+    if (!is_power_of_two(alignment)) {
+        arena->last_err = SP_ARENA_ERR_INVALID_ALIGNMENT;
+        return NULL;
+    }
+    if (alignment < arena->min_alignment) alignment = arena->min_alignment;
+
+    // Snapshot mappings are read only, none of the sync modes may touch them 
+    if (arena->mapped) {
+        arena->last_err = SP_ARENA_ERR_READ_ONLY;
+        return NULL;
+    }
+
+#if SP_ARENA_THREAD_SAFE
+    // The last allocation of a thread lives in its own chunk, resize it there
+    if (arena->config.sync == SP_ARENA_SYNC_THREAD_CACHE) {
+        sp_arena_thread_chunk *chunk = sp_arena_thread_chunk_find(__atomic_load_n(&arena->epoch, __ATOMIC_ACQUIRE));
+        if (chunk && (char*)old_ptr + old_size == chunk->cursor &&
+            (size_t)(chunk->end - (char*)old_ptr) >= new_size) {
+            chunk->cursor = (char*)old_ptr + new_size;
+            return old_ptr;
+        }
+
+        void *new_ptr = sp_arena_alloc_thread_cached(arena, new_size, alignment);
+        if (new_ptr) memcpy(new_ptr, old_ptr, old_size < new_size ? old_size : new_size);
+        return new_ptr;
+    }
+
+    if (arena->config.sync == SP_ARENA_SYNC_ATOMIC) {
+        return arena_resize_atomic(arena, old_ptr, old_size, new_size, alignment, false);
+    }
+#endif
+    
+    arena_lock(arena);
+    void *result = arena_resize_nolock(arena, old_ptr, old_size, new_size, alignment);
+    arena_unlock(arena);
     return result;
 }
 
 /* Resize an allocation from an arena */
 void *sp_arena_resize(sp_arena *arena, void *old_ptr, size_t old_size, size_t new_size) {
+    return sp_arena_resize_aligned(arena, old_ptr, old_size, new_size, arena ? arena->config.alignment : 1);
+}
+
+/* Resize an allocation while the caller holds the arena lock */
+void *sp_arena_resize_unlocked(sp_arena *arena, void *old_ptr, size_t old_size, size_t new_size) {
     if (!arena || !old_ptr || old_size == 0 || new_size == 0) {
         if (arena) arena->last_err = SP_ARENA_ERR_INVALID_SIZE;
         return NULL;
     }
-    
+
+    if (arena->mapped) {
+        arena->last_err = SP_ARENA_ERR_READ_ONLY;
+        return NULL;
+    }
+
+    size_t alignment = arena->config.alignment;
 #if SP_ARENA_THREAD_SAFE
-    pthread_mutex_lock(&arena->mutex);
+    if (arena->config.sync == SP_ARENA_SYNC_ATOMIC) {
+        return arena_resize_atomic(arena, old_ptr, old_size, new_size, alignment, true);
+    }
 #endif
+    return arena_resize_nolock(arena, old_ptr, old_size, new_size, alignment);
+}
+
+/* Copy without pulling the destination into the cache, dst must be cache line aligned */
+static void arena_stream_copy(void *dst, const void *src, size_t size) {
+    char *d = dst;
+    const char *s = src;
+    size_t streamed = size & ~(size_t)63;
+#if defined(__AVX2__)
+    for (size_t i = 0; i < streamed; i += 64) {
+        __m256i a = _mm256_loadu_si256((const __m256i *)(s + i));
+        __m256i b = _mm256_loadu_si256((const __m256i *)(s + i + 32));
+        _mm256_stream_si256((__m256i *)(d + i), a);
+        _mm256_stream_si256((__m256i *)(d + i + 32), b);
+    }
+    _mm_sfence();
+#elif defined(__SSE2__)
+    for (size_t i = 0; i < streamed; i += 64) {
+        __m128i a = _mm_loadu_si128((const __m128i *)(s + i));
+        __m128i b = _mm_loadu_si128((const __m128i *)(s + i + 16));
+        __m128i c = _mm_loadu_si128((const __m128i *)(s + i + 32));
+        __m128i e = _mm_loadu_si128((const __m128i *)(s + i + 48));
+        _mm_stream_si128((__m128i *)(d + i), a);
+        _mm_stream_si128((__m128i *)(d + i + 16), b);
+        _mm_stream_si128((__m128i *)(d + i + 32), c);
+        _mm_stream_si128((__m128i *)(d + i + 48), e);
+    }
+    _mm_sfence();
+#else
+    streamed = 0;
+#endif
+    memcpy(d + streamed, s + streamed, size - streamed);
+}
+
+/* Allocate and copy a memory region, streaming large copies past the cache */
+void *sp_arena_memdup(sp_arena *arena, const void *src, size_t size) {
+    if (!src) return NULL;
+
+    if (size >= SP_ARENA_STREAM_THRESHOLD) {
+        void *dup = sp_arena_alloc_aligned(arena, size, SP_ARENA_CACHE_LINE_SIZE);
+        if (dup) arena_stream_copy(dup, src, size);
+        return dup;
+    }
+
+    void *dup = sp_arena_alloc(arena, size);
+    if (dup) memcpy(dup, src, size);
+    return dup;
+}
+
+/* Allocate and copy a string, scanning for its end while copying it into the current block */
+char *sp_arena_strdup(sp_arena *arena, const char *str) {
+    if (!arena || !str) return NULL;
 
-    sp_arena_block *block = arena->current;
-    if (!block) {
-        arena->last_err = SP_ARENA_ERR_INVALID_ARENA;
 #if SP_ARENA_THREAD_SAFE
-        pthread_mutex_unlock(&arena->mutex);
+    // Lock-free arenas don't own the tail of the current block 
+    if (arena->config.sync == SP_ARENA_SYNC_THREAD_CACHE || arena->config.sync == SP_ARENA_SYNC_ATOMIC) {
+        return sp_arena_memdup(arena, str, strlen(str) + 1);
+    }
 #endif
+
+    // The tail copy starts unaligned, isolating arenas need every string on its own line, 
+    // and debug builds keep the tail poisoned 
+    if (SP_ARENA_DEBUG || arena->min_alignment > 1) return sp_arena_memdup(arena, str, strlen(str) + 1);
+
+    arena_lock(arena);
+    sp_arena_block *block = arena->current;
+    // Copying stops at the prefetch watermark, so the string that passes it takes the slow path 
+    if (block && block->used < block->limit) {
+        char *tail = sp_arena_block_memory(block) + block->used;
+        size_t room = block->limit - block->used;
+        char *end = memccpy(tail, str, '\0', room);
+        if (end) {
+            size_t len = (size_t)(end - tail);
+            sp_arena_count_alloc(arena, 0);
+            block->used += len;
+            arena->total_used += len;
+            arena_unlock(arena);
+            return tail;
+        }
+
+        // The string didn't fit, the tail it was copied into is dirty now 
+        if (block->used + room > block->dirty) block->dirty = block->used + room;
+    }
+    arena_unlock(arena);
+
+    return sp_arena_memdup(arena, str, strlen(str) + 1);
+}
+
+/* Allocate and copy at most n bytes of a string */
+char *sp_arena_strndup(sp_arena *arena, const char *str, size_t n) {
+    if (!str) return NULL;
+
+    size_t len = strnlen(str, n);
+    if (len == SIZE_MAX) {
+        if (arena) arena->last_err = SP_ARENA_ERR_ALLOCATION_TOO_LARGE;
         return NULL;
     }
 
-    // Check if old_ptr is at the end of the current block
-    char *block_end = (char*)block->memory + block->used - old_size;
-    if ((char*)old_ptr != block_end) {
-        // Not the last allocation, need to allocate new memory
-        void *new_ptr = sp_arena_alloc(arena, new_size);
-        if (new_ptr) {
-            // Copy old data to new location
-            size_t copy_size = old_size < new_size ? old_size : new_size;
-            memcpy(new_ptr, old_ptr, copy_size);
+    char *dup = sp_arena_alloc_aligned(arena, len + 1, 1);
+    if (dup) {
+        memcpy(dup, str, len);
+        dup[len] = '\0';
+    }
+    return dup;
+}
+
+/* Grow an arena backed array, in place when it is the last allocation */
+void *sp_arena_vec_grow(sp_arena *arena, void *data, size_t *cap, size_t min_cap, size_t elem_size) {
+    if (!arena || elem_size == 0) return data;
+    if (min_cap <= *cap) return data;
+
+    // Double the capacity, starting from a cache line worth of elements 
+    size_t new_cap = *cap ? *cap : (elem_size < SP_ARENA_CACHE_LINE_SIZE ? SP_ARENA_CACHE_LINE_SIZE / elem_size : 1);
+    if (*cap && new_cap <= SIZE_MAX / 2) new_cap *= 2;
+    if (new_cap < min_cap) new_cap = min_cap;
+    if (new_cap > SIZE_MAX / elem_size) {
+        arena->last_err = SP_ARENA_ERR_ALLOCATION_TOO_LARGE;
+        return data;
+    }
+
+    // Element sizes are multiples of their alignment, the lowest set bit covers it 
+    size_t alignment = elem_size & (~elem_size + 1);
+    void *grown = data ? sp_arena_resize_aligned(arena, data, *cap * elem_size, new_cap * elem_size, alignment)
+                       : sp_arena_alloc_aligned(arena, new_cap * elem_size, alignment);
+    if (!grown) return data;
+
+    *cap = new_cap;
+    return grown;
+}
+
+/* Start an empty string builder */
+void sp_arena_sb_init(sp_arena_sb *sb, sp_arena *arena) {
+    sb->arena = arena;
+    sb->data = NULL;
+    sb->len = 0;
+    sb->cap = 0;
+}
+
+/* Append bytes to a string builder, keeping it NUL terminated */
+bool sp_arena_sb_append(sp_arena_sb *sb, const char *str, size_t len) {
+    if (len >= SIZE_MAX - sb->len) return false;
+
+    size_t needed = sb->len + len + 1;
+    if (needed > sb->cap) {
+        sb->data = sp_arena_vec_grow(sb->arena, sb->data, &sb->cap, needed, 1);
+        if (needed > sb->cap) return false;
+    }
+
+    if (len) memcpy(sb->data + sb->len, str, len);
+    sb->len += len;
+    sb->data[sb->len] = '\0';
+    return true;
+}
+
+/* Append formatted text, formatting straight into the builder's free capacity */
+bool sp_arena_sb_appendf(sp_arena_sb *sb, const char *fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    size_t available = sb->cap - sb->len;
+    int written = vsnprintf(available ? sb->data + sb->len : NULL, available, fmt, args);
+    va_end(args);
+    if (written < 0) return false;
+
+    // Didn't fit, grow once to the exact length and format again 
+    if ((size_t)written >= available) {
+        size_t needed = sb->len + (size_t)written + 1;
+        sb->data = sp_arena_vec_grow(sb->arena, sb->data, &sb->cap, needed, 1);
+        if (needed > sb->cap) {
+            if (sb->data) sb->data[sb->len] = '\0';
+            return false;
+        }
+
+        va_start(args, fmt);
+        vsnprintf(sb->data + sb->len, sb->cap - sb->len, fmt, args);
+        va_end(args);
+    }
+
+    sb->len += (size_t)written;
+    return true;
+}
+
+/* Contents of a string builder, never NULL */
+const char *sp_arena_sb_cstr(const sp_arena_sb *sb) {
+    return sb->data ? sb->data : "";
+}
+
+/* Stack of open scope serials, the inline one until a scope nests deeper than it holds */
+static inline uint64_t *arena_scope_stack(sp_arena *arena) {
+    return arena->scope_heap ? arena->scope_heap : arena->scope_inline;
+}
+
+/* Whether the scope begun at depth with serial is still open, serials are never reused */
+static inline bool arena_scope_open(sp_arena *arena, size_t depth, uint64_t serial) {
+    return depth != 0 && depth <= arena->temp_depth && arena_scope_stack(arena)[depth - 1] == serial;
+}
+
+/* Create a slab allocator, objects have room for the free list link */
+sp_arena_slab sp_arena_slab_create(sp_arena *arena, size_t object_size, size_t alignment) {
+    sp_arena_slab slab;
+    memset(&slab, 0, sizeof(slab));
+    slab.arena = arena;
+    if (!is_power_of_two(alignment) || object_size == 0) return slab;
+
+    if (alignment < SP_ARENA_ALIGNOF(void *)) alignment = SP_ARENA_ALIGNOF(void *);
+    if (object_size < sizeof(void *)) object_size = sizeof(void *);
+    if (object_size > SIZE_MAX - alignment) return slab;
+
+    slab.object_size = align_forward(object_size, alignment);
+    slab.alignment = alignment;
+    slab.clears = arena ? arena->clears : 0;
+    return slab;
+}
+
+/* Whether the memory a slab took is still there, only a clear or the end of the scope its 
+ * newest slab came from rewinds below it */
+static inline bool slab_alive(const sp_arena_slab *slab) {
+    sp_arena *arena = slab->arena;
+    return slab->clears == arena->clears && 
+           (slab->depth == 0 || arena_scope_open(arena, slab->depth, slab->serial));
+}
+
+/* Pop the free list, then bump the newest slab, then take a new slab from the arena */
+void *sp_arena_slab_alloc(sp_arena_slab *slab) {
+    sp_arena *arena = slab->arena;
+    if (!arena || slab->object_size == 0) return NULL;
+
+    // The arena was cleared or rewound below the slabs, everything the slab handed out is gone 
+    if (!slab_alive(slab)) {
+        slab->free_list = NULL;
+        slab->cursor = NULL;
+        slab->end = NULL;
+        slab->clears = arena->clears;
+        slab->depth = 0;
+    }
+
+    if (slab->free_list) {
+        void *object = slab->free_list;
+        slab->free_list = *(void **)object;
+        return object;
+    }
+
+    if ((size_t)(slab->end - slab->cursor) < slab->object_size) {
+        size_t count = SP_ARENA_SLAB_SIZE / slab->object_size;
+        if (count == 0) count = 1;
+
+        char *memory = sp_arena_alloc_aligned(arena, count * slab->object_size, slab->alignment);
+        if (!memory) return NULL;
+
+        // Older slabs were taken in this scope or one enclosing it, this one goes first 
+        slab->depth = arena->temp_depth;
+        slab->serial = arena->temp_depth ? arena_scope_stack(arena)[arena->temp_depth - 1] : 0;
+        slab->cursor = memory;
+        slab->end = memory + count * slab->object_size;
+    }
+
+    void *object = slab->cursor;
+    slab->cursor += slab->object_size;
+    return object;
+}
+
+/* Push an object on the free list, objects a clear or rewind dropped are already gone */
+void sp_arena_slab_free(sp_arena_slab *slab, void *ptr) {
+    if (!ptr || !slab->arena || !slab_alive(slab)) return;
+
+    *(void **)ptr = slab->free_list;
+    slab->free_list = ptr;
+}
+
+/* Start one slab allocator per power of two size class */
+void sp_arena_slab_classes_init(sp_arena_slab_classes *classes, sp_arena *arena) {
+    classes->arena = arena;
+    for (size_t i = 0; i < SP_ARENA_SLAB_CLASSES; i++) {
+        size_t size = (size_t)8 << i;
+        classes->classes[i] = sp_arena_slab_create(arena, size, size < 16 ? size : 16);
+    }
+}
+
+/* Size class of a request, SP_ARENA_SLAB_CLASSES when it is larger than every class */
+static inline size_t slab_class_index(size_t size) {
+    if (size <= 8) return 0;
+    size_t index = log2_size(size - 1) - 2;
+    return index < SP_ARENA_SLAB_CLASSES ? index : SP_ARENA_SLAB_CLASSES;
+}
+
+void *sp_arena_slab_classes_alloc(sp_arena_slab_classes *classes, size_t size) {
+    size_t index = slab_class_index(size);
+    if (index == SP_ARENA_SLAB_CLASSES) return sp_arena_alloc(classes->arena, size);
+    return sp_arena_slab_alloc(&classes->classes[index]);
+}
+
+void sp_arena_slab_classes_free(sp_arena_slab_classes *classes, void *ptr, size_t size) {
+    size_t index = slab_class_index(size);
+    if (index < SP_ARENA_SLAB_CLASSES) sp_arena_slab_free(&classes->classes[index], ptr);
+}
+
+#define SP_ARENA_MAP_GROUP 16
+#define SP_ARENA_MAP_EMPTY 0x80
+
+/* 64 bit multiply-mix hash of the key bytes */
+static uint64_t map_hash(const void *key, size_t len) {
+    const uint8_t *bytes = key;
+    uint64_t hash = 0x9E3779B97F4A7C15ULL ^ (len * 0xC2B2AE3D27D4EB4FULL);
+    while (len >= 8) {
+        uint64_t word;
+        memcpy(&word, bytes, 8);
+        hash = (hash ^ (word * 0xBF58476D1CE4E5B9ULL)) * 0x94D049BB133111EBULL;
+        hash ^= hash >> 29;
+        bytes += 8;
+        len -= 8;
+    }
+
+    uint64_t tail = 0;
+    memcpy(&tail, bytes, len);
+    hash = (hash ^ (tail * 0xBF58476D1CE4E5B9ULL)) * 0x94D049BB133111EBULL;
+    return hash ^ (hash >> 31);
+}
+
+/* Bit i set when control byte i of the group equals `byte` */
+static inline uint32_t map_group_match(const uint8_t *group, uint8_t byte) {
+#if defined(__SSE2__)
+    __m128i ctrl = _mm_load_si128((const __m128i *)group);
+    return (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(ctrl, _mm_set1_epi8((char)byte)));
+#else
+    uint32_t mask = 0;
+    for (size_t i = 0; i < SP_ARENA_MAP_GROUP; i++) mask |= (uint32_t)(group[i] == byte) << i;
+    return mask;
+#endif
+}
+
+/* Top 7 bits of the hash go in the control byte, the rest picks the first group */
+static inline uint8_t map_h2(uint64_t hash) {
+    return (uint8_t)(hash >> 57);
+}
+
+/* Place an entry index in the first empty slot of its probe sequence */
+static void map_index_insert(sp_arena_map *map, uint64_t hash, uint32_t index) {
+    size_t group_mask = map->capacity / SP_ARENA_MAP_GROUP - 1;
+    size_t group = (size_t)hash & group_mask;
+    for (size_t step = 1;; step++) {
+        uint32_t empty = map_group_match(map->ctrl + group * SP_ARENA_MAP_GROUP, SP_ARENA_MAP_EMPTY);
+        if (empty) {
+            size_t slot = group * SP_ARENA_MAP_GROUP + lowest_bit(empty);
+            map->ctrl[slot] = map_h2(hash);
+            map->slots[slot] = index;
+            return;
+        }
+        group = (group + step) & group_mask;
+    }
+}
+
+/* Rebuild the index with `capacity` slots, in insertion order */
+static bool map_rehash(sp_arena_map *map, size_t capacity) {
+    size_t sizes[2] = { capacity, capacity * sizeof(uint32_t) };
+    size_t aligns[2] = { SP_ARENA_MAP_GROUP, SP_ARENA_ALIGNOF(uint32_t) };
+    void *pieces[2];
+    if (!sp_arena_alloc_batch(map->arena, sizes, aligns, pieces, 2)) return false;
+
+    map->ctrl = pieces[0];
+    map->slots = pieces[1];
+    map->capacity = capacity;
+    memset(map->ctrl, SP_ARENA_MAP_EMPTY, capacity);
+    for (size_t i = 0; i < map->count; i++) map_index_insert(map, map->entries[i].hash, (uint32_t)i);
+    return true;
+}
+
+void sp_arena_map_init(sp_arena_map *map, sp_arena *arena) {
+    memset(map, 0, sizeof(*map));
+    map->arena = arena;
+}
+
+/* Grow the entries through sp_arena_resize and the index to stay under 7/8 full */
+bool sp_arena_map_reserve(sp_arena_map *map, size_t count) {
+    if (count > UINT32_MAX) return false;
+
+    if (count > map->entry_cap) {
+        map->entries = sp_arena_vec_grow(map->arena, map->entries, &map->entry_cap, count, sizeof(sp_arena_map_entry));
+        if (count > map->entry_cap) return false;
+    }
+
+    size_t capacity = map->capacity ? map->capacity : SP_ARENA_MAP_GROUP;
+    while (count > capacity / 8 * 7) capacity *= 2;
+    return capacity == map->capacity || map_rehash(map, capacity);
+}
+
+/* Probe group by group for the key, stopping at the first group with an empty slot */
+static sp_arena_map_entry *map_lookup(const sp_arena_map *map, const void *key, size_t len, uint64_t hash) {
+    if (!map->capacity) return NULL;
+
+    size_t group_mask = map->capacity / SP_ARENA_MAP_GROUP - 1;
+    size_t group = (size_t)hash & group_mask;
+    for (size_t step = 1; step <= group_mask + 1; step++) {
+        const uint8_t *ctrl = map->ctrl + group * SP_ARENA_MAP_GROUP;
+        for (uint32_t match = map_group_match(ctrl, map_h2(hash)); match; match &= match - 1) {
+            sp_arena_map_entry *entry = &map->entries[map->slots[group * SP_ARENA_MAP_GROUP + lowest_bit(match)]];
+            if (entry->hash == hash && entry->key_len == len && memcmp(entry->key, key, len) == 0) return entry;
         }
-        
-#if SP_ARENA_THREAD_SAFE
-        pthread_mutex_unlock(&arena->mutex);
-#endif
-        return new_ptr;
+        if (map_group_match(ctrl, SP_ARENA_MAP_EMPTY)) return NULL;
+        group = (group + step) & group_mask;
     }
-    
-    // We can resize in place
-    if (new_size > old_size) {
-        size_t additional = new_size - old_size;
-        if (block->used + additional > block->size) {
-            // Not enough space, allocate new memory
-            if (arena->config.fixed_size) {
-                arena->last_err = SP_ARENA_ERR_OUT_OF_MEMORY;
-#if SP_ARENA_THREAD_SAFE
-                pthread_mutex_unlock(&arena->mutex);
-#endif
-                return NULL;
+    return NULL;
+}
+
+sp_arena_map_entry *sp_arena_map_find(const sp_arena_map *map, const void *key, size_t len) {
+    return map_lookup(map, key, len, map_hash(key, len));
+}
+
+sp_arena_map_entry *sp_arena_map_insert(sp_arena_map *map, const void *key, size_t len) {
+    uint64_t hash = map_hash(key, len);
+    sp_arena_map_entry *entry = map_lookup(map, key, len, hash);
+    if (entry) return entry;
+
+    if (len == SIZE_MAX || !sp_arena_map_reserve(map, map->count + 1)) return NULL;
+
+    char *copy = sp_arena_alloc_aligned(map->arena, len + 1, 1);
+    if (!copy) return NULL;
+    if (len) memcpy(copy, key, len);
+    copy[len] = '\0';
+
+    entry = &map->entries[map->count];
+    entry->key = copy;
+    entry->key_len = len;
+    entry->hash = hash;
+    entry->value = NULL;
+    map_index_insert(map, hash, (uint32_t)map->count++);
+    return entry;
+}
+
+bool sp_arena_map_put(sp_arena_map *map, const void *key, size_t len, void *value) {
+    sp_arena_map_entry *entry = sp_arena_map_insert(map, key, len);
+    if (!entry) return false;
+    entry->value = value;
+    return true;
+}
+
+/* Later entries only ever probed past earlier ones, so emptying their slots keeps every 
+ * earlier entry reachable */
+void sp_arena_map_rewind(sp_arena_map *map, size_t count) {
+    while (map->count > count) {
+        sp_arena_map_entry *entry = &map->entries[--map->count];
+        size_t group_mask = map->capacity / SP_ARENA_MAP_GROUP - 1;
+        size_t group = (size_t)entry->hash & group_mask;
+        for (size_t step = 1;; step++) {
+            uint8_t *ctrl = map->ctrl + group * SP_ARENA_MAP_GROUP;
+            uint32_t match = map_group_match(ctrl, map_h2(entry->hash));
+            for (; match; match &= match - 1) {
+                size_t slot = group * SP_ARENA_MAP_GROUP + lowest_bit(match);
+                if (map->slots[slot] == map->count) break;
             }
-            
-            void *new_ptr = sp_arena_alloc(arena, new_size);
-            if (new_ptr) {
-                // Copy old data
-                memcpy(new_ptr, old_ptr, old_size);
-                // Adjust the old block's used size
-                block->used -= old_size;
-                arena->total_used -= old_size;
+            if (match) {
+                ctrl[lowest_bit(match)] = SP_ARENA_MAP_EMPTY;
+                break;
             }
-            
-#if SP_ARENA_THREAD_SAFE
-            pthread_mutex_unlock(&arena->mutex);
-#endif
-            return new_ptr;
+            group = (group + step) & group_mask;
         }
     }
-    
-    // Adjust block size
-    block->used = block->used - old_size + new_size;
-    arena->total_used = arena->total_used - old_size + new_size;
-    
-#if SP_ARENA_THREAD_SAFE
-    pthread_mutex_unlock(&arena->mutex);
-#endif
-    return old_ptr;
 }
 
-/* Allocate and copy a string into an arena */
-char *sp_arena_strdup(sp_arena *arena, const char *str) {
-    if (!str) return NULL;
-
-    size_t len = strlen(str) + 1;
-    char *dup = sp_arena_alloc(arena, len);
-    if (dup) memcpy(dup, str, len);
-    return dup;
+const char *sp_arena_intern(sp_arena_map *map, const char *str, size_t len) {
+    sp_arena_map_entry *entry = sp_arena_map_insert(map, str, len);
+    return entry ? entry->key : NULL;
 }
 
 /* Create a temporary checkpoint for the arena */ 
+/* Called through a volatile pointer so clearing memory about to be freed isn't optimised away */
+static void *(*volatile arena_memset)(void *, int, size_t) = memset;
+
+/* Zero or poison the used part of a block from `from` on as config.clear_mode asks and rewind it 
+ * there, caller must hold the arena lock */
+static void arena_scrub_block(sp_arena *arena, sp_arena_block *block, size_t from) {
+    char *start = sp_arena_block_memory(block) + from;
+    size_t size = block->used - from;
+
+    // Redzones are scrubbed along with the allocations around them 
+    debug_unpoison(start, size);
+    if (arena->config.clear_mode == SP_ARENA_CLEAR_ZERO) {
+        arena_memset(start, 0, size);
+        debug_poison_unused(start, size);
+        if (block->dirty <= block->used) block->dirty = from;
+        block->used = from;
+        return;
+    }
+
+    arena_memset(start, SP_ARENA_POISON_BYTE, size);
+    block_rewind(block, from);
+}
+
+/* Make room for one more open scope, caller must hold the arena lock */
+static bool arena_scope_reserve(sp_arena *arena) {
+    size_t capacity = arena->scope_heap ? arena->scope_capacity : SP_ARENA_INLINE_SCOPES;
+    if (arena->temp_depth < capacity) return true;
+
+    // Another process's heap pointer means nothing here 
+    if (arena->shared || capacity > SIZE_MAX / 2 / sizeof(uint64_t)) return false;
+
+    uint64_t *stack = (uint64_t *)realloc(arena->scope_heap, capacity * 2 * sizeof(uint64_t));
+    if (!stack) return false;
+    if (!arena->scope_heap) memcpy(stack, arena->scope_inline, sizeof(arena->scope_inline));
+    arena->scope_heap = stack;
+    arena->scope_capacity = capacity * 2;
+    return true;
+}
+
 sp_arena_temp sp_arena_temp_begin(sp_arena *arena) {
     sp_arena_temp temp;
+    memset(&temp, 0, sizeof(temp));
     temp.arena = arena;
 
-    if (!arena || !arena->current) {
-        temp.block = NULL;
-        temp.total_used = 0;
-        temp.used = 0;
+    if (!arena || !arena->current || arena->mapped) {
+        if (arena && arena->mapped) arena->last_err = SP_ARENA_ERR_READ_ONLY;
         return temp;
     }
     
-#if SP_ARENA_THREAD_SAFE
-    pthread_mutex_lock(&arena->mutex);
-#endif
+    arena_lock(arena);
+
+    sp_arena_block *block = arena->current;
+    size_t used = block_load_used(block);
+    size_t total_used = arena->total_used;
+    if (!arena_scope_reserve(arena)) {
+        arena->last_err = SP_ARENA_ERR_OUT_OF_MEMORY;
+        arena_unlock(arena);
+        return temp;
+    }
 
-    temp.block = arena->current;
-    temp.used = arena->current->used;
-    temp.total_used = arena->total_used;
+    temp.serial = ++arena->scope_serial;
+    arena_scope_stack(arena)[arena->temp_depth] = temp.serial;
+    temp.depth = ++arena->temp_depth;
+    temp.block = block;
+    temp.used = used;
+    temp.large = arena->large;
+    temp.total_used = total_used;
+
+    // Retire the threads' chunks so allocations inside the scope land after the checkpoint 
+    arena_bump_epoch(arena);
     
-#if SP_ARENA_THREAD_SAFE
-    pthread_mutex_unlock(&arena->mutex);
-#endif
+    arena_unlock(arena);
 
     return temp;
 }
@@ -353,70 +2345,217 @@ sp_arena_temp sp_arena_temp_begin(sp_arena *arena) {
 void sp_arena_temp_end(sp_arena_temp temp) {
     sp_arena *arena = temp.arena;
     if (!arena || !temp.block) return;
-#if SP_ARENA_THREAD_SAFE
-    pthread_mutex_lock(&arena->mutex);
-#endif
+    arena_lock(arena);
 
-    // Restore the arena to the state at the temporary checkpoint 
-    arena->current = temp.block;
-    
-    // Reset the used amount of all blocks after the checkpoint block 
+    // It's stale when it ended already or a clear or enclosing scope ended it, the scopes 
+    // opened inside this one end with it 
+    if (!arena_scope_open(arena, temp.depth, temp.serial)) {
+        arena_unlock(arena);
+        return;
+    }
+    arena->temp_depth = temp.depth - 1;
+
+    // Secure clear modes scrub what the scope gives back too, retired blocks are only 
+    // rewound and a later clear wouldn't see their old contents 
     sp_arena_block* block = temp.block;
-    block->used = temp.used;
+    if (arena->config.clear_mode != SP_ARENA_CLEAR_NONE) {
+        for (sp_arena_block *dead = block->next; dead; dead = dead->next) arena_scrub_block(arena, dead, 0);
+        for (sp_arena_block *dead = arena->large; dead && dead != temp.large; dead = dead->next) {
+            arena_scrub_block(arena, dead, 0);
+        }
+        if (block->used > temp.used) arena_scrub_block(arena, block, temp.used);
+    }
+
+    // Reset the used amount of the checkpoint block and retire all blocks after it 
+    block_rewind(block, temp.used);
+    arena_release_after(arena, block);
+
+    // Restore the arena to the state at the temporary checkpoint 
+    arena_set_current(arena, block);
     
+    // Large allocations made inside the scope are given back 
+    sp_arena_free_large(arena, temp.large, arena->config.retain_large);
+
+    arena_note_peak(arena);
     arena->total_used = temp.total_used;
+    arena_bump_epoch(arena);
     
-#if SP_ARENA_THREAD_SAFE
-    pthread_mutex_unlock(&arena->mutex);
-#endif
+    arena_unlock(arena);
+}
+
+/* Free retained blocks, largest first, until the arena holds at most keep_bytes. 
+ * The first block is always kept, caller must hold the arena lock */
+static void arena_trim_nolock(sp_arena *arena, size_t keep_bytes) {
+    arena_drain_pending(arena);
+
+    // Virtual memory arenas give back committed pages past what's in use 
+    if (arena->reserved) {
+        sp_arena_block *block = arena->first;
+        size_t keep = block->used + SP_ARENA_BLOCK_HEADER_SIZE;
+        if (keep < keep_bytes) keep = keep_bytes;
+        keep = align_forward(keep < arena->config.commit_size ? arena->config.commit_size : keep, 
+                             arena->config.commit_size);
+
+        size_t committed = block->size + SP_ARENA_BLOCK_HEADER_SIZE;
+        if (committed > keep) {
+            os_decommit((char *)block + keep, committed - keep);
+            block_set_size(block, keep - SP_ARENA_BLOCK_HEADER_SIZE);
+            block_decommitted(block, block->size);
+            arena_arm_block(arena, block);
+            arena->total_allocated -= committed - keep;
+        }
+        return;
+    }
+
+    while (arena->free_mask && arena->total_allocated > keep_bytes) {
+        size_t bin = log2_size(arena->free_mask);
+        sp_arena_block *block = arena_bin_pop(arena, bin);
+        arena->total_allocated -= block->size + SP_ARENA_BLOCK_HEADER_SIZE;
+        sp_arena_free_block(arena, block);
+    }
+
+    // The prefetched block goes last, it's the next one to be used 
+    if (arena->prefetched && arena->total_allocated > keep_bytes) {
+        arena->total_allocated -= arena->prefetched->size + SP_ARENA_BLOCK_HEADER_SIZE;
+        sp_arena_free_block(arena, arena->prefetched);
+        arena->prefetched = NULL;
+    }
+}
+
+/* Age the blocks that sat in the free bins for a whole clear cycle and free the ones 
+ * idle for config.decay_clears clears, caller must hold the arena lock */
+static void arena_decay_nolock(sp_arena *arena) {
+    uint64_t mask = arena->free_mask;
+    while (mask) {
+        size_t bin = lowest_bit(mask);
+        mask &= mask - 1;
+
+        sp_arena_block **link = &arena->free_bins[bin];
+        while (*link) {
+            sp_arena_block *block = *link;
+            if (++block->idle_clears < arena->config.decay_clears) {
+                link = &block->next;
+                continue;
+            }
+
+            *link = block->next;
+            arena->total_allocated -= block->size + SP_ARENA_BLOCK_HEADER_SIZE;
+            sp_arena_free_block(arena, block);
+        }
+        if (!arena->free_bins[bin]) arena->free_mask &= ~((uint64_t)1 << bin);
+    }
+}
+
+/* Release retained memory until the arena holds at most keep_bytes */
+void sp_arena_trim(sp_arena *arena, size_t keep_bytes) {
+    if (!arena || arena->mapped) return;
+    arena_lock(arena);
+    arena_trim_nolock(arena, keep_bytes);
+    arena_unlock(arena);
 }
 
 /* Clear arena, keeping its memory for reuse */ 
 void sp_arena_clear(sp_arena *arena) {
     if (!arena) return;
-#if SP_ARENA_THREAD_SAFE
-    pthread_mutex_lock(&arena->mutex);
-#endif
+    if (arena->mapped) {
+        arena->last_err = SP_ARENA_ERR_READ_ONLY;
+        return;
+    }
+    arena_lock(arena);
 
-    sp_arena_block *block = arena->first;
-    while (block) {
-        block->used = 0;
-        block = block->next;
+    // Blocks nobody took since the last clear get older, the ones just used start fresh 
+    if (arena->config.decay_clears) arena_decay_nolock(arena);
+
+    if (arena->config.clear_mode != SP_ARENA_CLEAR_NONE) {
+        for (sp_arena_block *block = arena->first; block; block = block->next) arena_scrub_block(arena, block, 0);
+        for (sp_arena_block *block = arena->large; block; block = block->next) arena_scrub_block(arena, block, 0);
     }
 
-    arena->current = arena->first;
+    // Keep the first block in place and retire the rest, decay needs them binned by the next clear 
+    block_rewind(arena->first, 0);
+    arena_release_after(arena, arena->first);
+    if (arena->config.decay_clears) arena_drain_pending(arena);
+
+    // Keep the first commit of a virtual memory arena and give the rest back 
+    sp_arena_block *first = arena->first;
+    size_t committed = first->size + SP_ARENA_BLOCK_HEADER_SIZE;
+    if (arena->reserved && arena->config.decommit_on_clear && committed > arena->config.commit_size) {
+        debug_unpoison((char *)first + arena->config.commit_size, committed - arena->config.commit_size);
+        os_decommit((char *)first + arena->config.commit_size, committed - arena->config.commit_size);
+        block_set_size(first, arena->config.commit_size - SP_ARENA_BLOCK_HEADER_SIZE);
+        block_decommitted(first, first->size);
+        arena_arm_block(arena, first);
+        arena->total_allocated = arena->config.commit_size;
+    }
+
+    sp_arena_free_large(arena, NULL, arena->config.retain_large);
+
+    arena_set_current(arena, arena->first);
+    arena_note_peak(arena);
     arena->total_used = 0;
+    arena->temp_depth = 0;
+    arena->clears++;
+    arena_bump_epoch(arena);
 
-#if SP_ARENA_THREAD_SAFE
-    pthread_mutex_unlock(&arena->mutex);
-#endif
+    arena_unlock(arena);
 }
 
 void sp_arena_destroy(sp_arena *arena) {
     if (!arena) return;
+
+    // Other processes may still use the shared arena, only drop this process's mapping 
+    if (arena->shared) {
+        debug_unpoison(sp_arena_block_memory(arena->first), arena->first->size);
+        os_release(arena, arena->shared);
+        return;
+    }
+
 #if SP_ARENA_THREAD_SAFE
-    pthread_mutex_lock(&arena->mutex);
+    arena_prefetch_stop(arena);
 #endif
+    arena_lock(arena);
 
     sp_arena_block *block = arena->first;
+    if (arena->reserved) debug_unpoison(sp_arena_block_memory(block), block->size);
+    if (arena->reserved) {
+        os_release(block, arena->reserved);
+        block = NULL;
+    }
+
+    // The snapshot mapping starts on the page holding the block header 
+    if (arena->mapped) {
+        os_release((char *)block - ((uintptr_t)block & (arena->page_size - 1)), arena->mapped);
+        block = NULL;
+    }
+
     while (block) {
         sp_arena_block *next = block->next;
-        arena->config.deallocator(block->memory);
-        arena->config.deallocator(block);
+        sp_arena_free_block(arena, block);
         block = next;
     }
 
+    arena_drain_pending(arena);
+    for (size_t bin = 0; bin < SP_ARENA_FREE_BINS; bin++) {
+        while (arena->free_bins[bin]) {
+            sp_arena_free_block(arena, arena_bin_pop(arena, bin));
+        }
+    }
+    sp_arena_free_large(arena, NULL, false);
+    if (arena->prefetched) sp_arena_free_block(arena, arena->prefetched);
+    free(arena->scope_heap);
+
     arena->first = NULL;
+    arena->prefetched = NULL;
     arena->current = NULL;
     arena->total_allocated = 0;
     arena->total_used = 0;
 
+    arena_unlock(arena);
 #if SP_ARENA_THREAD_SAFE
-    pthread_mutex_unlock(&arena->mutex);
     pthread_mutex_destroy(&arena->mutex);
 #endif
 
-    free(arena);
+    arena_struct_free(arena);
 }
 
 sp_arena_err_t sp_arena_get_last_error(const sp_arena *arena) {
@@ -443,6 +2582,10 @@ const char *sp_arena_error_string(sp_arena_err_t error) {
         return "Invalid arena";
     case SP_ARENA_ERR_ALLOCATION_TOO_LARGE: 
         return "Allocation too large"; 
+    case SP_ARENA_ERR_READ_ONLY: 
+        return "Arena is read only"; 
+    case SP_ARENA_ERR_SNAPSHOT: 
+        return "Snapshot could not be written or read"; 
     default:        
         return "Unknown error";
     }
@@ -473,8 +2616,312 @@ float sp_arena_utilization(const sp_arena *arena) {
     }
 
 /* Get the report of memory utilisation by arena. */ 
-void sp_arena_usage_report(const sp_arena *arena) {
+void sp_arena_usage_report(sp_arena *arena) {
     printf("Total allocated: %zu bytes\n", sp_arena_total_allocated(arena));
     printf("Total used: %zu bytes\n", sp_arena_total_used(arena));
     printf("Utilization: %.2f%%\n", sp_arena_utilization(arena) * 100.0f);
-}
\ No newline at end of file
+    if (!arena) return;
+
+    sp_arena_stats stats = sp_arena_get_stats(arena);
+    printf("Peak used: %zu bytes\n", stats.peak_used);
+    printf("Blocks: %zu (%zu created)\n", stats.block_count, stats.blocks_created);
+    printf("Block tail waste: %zu bytes\n", stats.tail_waste);
+#if SP_ARENA_STATS
+    printf("Allocations: %zu\n", stats.allocations);
+    printf("Alignment padding: %zu bytes\n", stats.padding);
+    printf("Lock contentions: %zu (%.3f ms waiting)\n", stats.lock_contentions, (double)stats.lock_wait_ns / 1e6);
+#endif
+}
+
+/* Gather the arena's counters and count the blocks it holds */
+sp_arena_stats sp_arena_get_stats(sp_arena *arena) {
+    sp_arena_stats stats;
+    memset(&stats, 0, sizeof(stats));
+    if (!arena) return stats;
+
+    arena_lock(arena);
+    arena_note_peak(arena);
+    stats.total_allocated = arena->total_allocated;
+    stats.total_used = __atomic_load_n(&arena->total_used, __ATOMIC_RELAXED);
+    stats.peak_used = arena->peak_used;
+    stats.blocks_created = arena->blocks_created;
+    stats.tail_waste = arena->tail_waste;
+#if SP_ARENA_STATS
+    stats.allocations = __atomic_load_n(&arena->allocations, __ATOMIC_RELAXED);
+    stats.padding = __atomic_load_n(&arena->padding, __ATOMIC_RELAXED);
+    stats.lock_contentions = arena->lock_contentions;
+    stats.lock_wait_ns = arena->lock_wait_ns;
+#endif
+
+    for (sp_arena_block *block = arena->first; block; block = block->next) stats.block_count++;
+    for (sp_arena_block *block = arena->large; block; block = block->next) stats.block_count++;
+    for (sp_arena_block *block = arena->pending; block; block = block->next) stats.block_count++;
+    if (arena->prefetched) stats.block_count++;
+    for (size_t bin = 0; bin < SP_ARENA_FREE_BINS; bin++) {
+        for (sp_arena_block *block = arena->free_bins[bin]; block; block = block->next) stats.block_count++;
+    }
+
+    arena_unlock(arena);
+    return stats;
+}
+
+#if SP_ARENA_PROFILE
+static sp_arena_callsite profile_sites[SP_ARENA_PROFILE_SLOTS];
+#if SP_ARENA_THREAD_SAFE 
+static pthread_mutex_t profile_mutex = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+static inline void profile_lock(void) {
+#if SP_ARENA_THREAD_SAFE 
+    pthread_mutex_lock(&profile_mutex);
+#endif
+}
+
+static inline void profile_unlock(void) {
+#if SP_ARENA_THREAD_SAFE 
+    pthread_mutex_unlock(&profile_mutex);
+#endif
+}
+
+/* Open addressed on the line, a file's callsites may see different __FILE__ pointers per translation unit */
+void sp_arena_profile_record(const char *file, int line, size_t requested, size_t consumed) {
+    profile_lock();
+    size_t slot = ((size_t)line * 2654435761u) % SP_ARENA_PROFILE_SLOTS;
+    for (size_t probe = 0; probe < SP_ARENA_PROFILE_SLOTS; probe++) {
+        sp_arena_callsite *site = &profile_sites[slot];
+        if (!site->file) {
+            site->file = file;
+            site->line = line;
+        }
+        if (site->line == line && (site->file == file || strcmp(site->file, file) == 0)) {
+            site->count++;
+            site->requested += requested;
+            site->consumed += consumed;
+            break;
+        }
+        slot = (slot + 1) % SP_ARENA_PROFILE_SLOTS;
+    }
+    profile_unlock();
+}
+
+static int profile_compare(const void *a, const void *b) {
+    const sp_arena_callsite *x = a, *y = b;
+    return x->consumed < y->consumed ? 1 : x->consumed > y->consumed ? -1 : 0;
+}
+
+size_t sp_arena_profile_callsites(sp_arena_callsite *out, size_t max) {
+    if (!out) return 0;
+
+    size_t count = 0;
+    profile_lock();
+    for (size_t slot = 0; slot < SP_ARENA_PROFILE_SLOTS && count < max; slot++) {
+        if (profile_sites[slot].file) out[count++] = profile_sites[slot];
+    }
+    profile_unlock();
+
+    qsort(out, count, sizeof(*out), profile_compare);
+    return count;
+}
+
+void sp_arena_profile_report(void) {
+    sp_arena_callsite sites[SP_ARENA_PROFILE_SLOTS];
+    size_t count = sp_arena_profile_callsites(sites, SP_ARENA_PROFILE_SLOTS);
+    printf("%-40s %10s %14s %14s\n", "Callsite", "Count", "Requested", "Consumed");
+    for (size_t i = 0; i < count; i++) {
+        char where[512];
+        snprintf(where, sizeof(where), "%s:%d", sites[i].file, sites[i].line);
+        printf("%-40s %10zu %14zu %14zu\n", where, sites[i].count, sites[i].requested, sites[i].consumed);
+    }
+}
+
+void sp_arena_profile_reset(void) {
+    profile_lock();
+    memset(profile_sites, 0, sizeof(profile_sites));
+    profile_unlock();
+}
+#endif
+
+/* Create a pool of recycled arenas */
+sp_arena_pool *sp_arena_pool_create(sp_arena_config config, size_t max_arenas, size_t max_retained) {
+    if (max_arenas == 0) return NULL;
+
+    sp_arena_pool *pool = (sp_arena_pool *)malloc(sizeof(*pool));
+    if (!pool) return NULL;
+
+    memset(pool, 0, sizeof(*pool));
+    pool->arenas = (sp_arena **)malloc(max_arenas * sizeof(*pool->arenas));
+    if (!pool->arenas) {
+        free(pool);
+        return NULL;
+    }
+
+#if SP_ARENA_THREAD_SAFE 
+    if (pthread_mutex_init(&pool->mutex, NULL) != 0) {
+        free(pool->arenas);
+        free(pool);
+        return NULL;
+    }
+#endif
+
+    pool->config = config;
+    pool->max_arenas = max_arenas;
+    pool->max_retained = max_retained;
+    return pool;
+}
+
+/* Create arenas up front so the first acquires don't have to */
+size_t sp_arena_pool_prewarm(sp_arena_pool *pool, size_t count) {
+    if (!pool) return 0;
+
+    size_t created = 0;
+    while (created < count) {
+        sp_arena *arena = sp_arena_create_with_config(pool->config);
+        if (!arena) break;
+
+#if SP_ARENA_THREAD_SAFE 
+        pthread_mutex_lock(&pool->mutex);
+#endif
+        bool full = pool->count == pool->max_arenas;
+        if (!full) pool->arenas[pool->count++] = arena;
+#if SP_ARENA_THREAD_SAFE 
+        pthread_mutex_unlock(&pool->mutex);
+#endif
+
+        if (full) {
+            sp_arena_destroy(arena);
+            break;
+        }
+        created++;
+    }
+    return created;
+}
+
+/* Take a cleared arena from the pool, creating one if the pool is empty */
+sp_arena *sp_arena_pool_acquire(sp_arena_pool *pool) {
+    if (!pool) return NULL;
+
+    sp_arena *arena = NULL;
+#if SP_ARENA_THREAD_SAFE 
+    pthread_mutex_lock(&pool->mutex);
+#endif
+    if (pool->count) arena = pool->arenas[--pool->count];
+#if SP_ARENA_THREAD_SAFE 
+    pthread_mutex_unlock(&pool->mutex);
+#endif
+
+    return arena ? arena : sp_arena_create_with_config(pool->config);
+}
+
+/* Clear an arena and hand it back to the pool, destroying it if the pool is full */
+void sp_arena_pool_release(sp_arena_pool *pool, sp_arena *arena) {
+    if (!arena) return;
+    if (!pool) {
+        sp_arena_destroy(arena);
+        return;
+    }
+
+    sp_arena_clear(arena);
+    if (pool->max_retained) {
+        arena_lock(arena);
+        arena_trim_nolock(arena, pool->max_retained);
+        arena_unlock(arena);
+    }
+    arena->last_err = SP_ARENA_ERR_NONE;
+
+#if SP_ARENA_THREAD_SAFE 
+    pthread_mutex_lock(&pool->mutex);
+#endif
+    bool full = pool->count == pool->max_arenas;
+    if (!full) pool->arenas[pool->count++] = arena;
+#if SP_ARENA_THREAD_SAFE 
+    pthread_mutex_unlock(&pool->mutex);
+#endif
+
+    if (full) sp_arena_destroy(arena);
+}
+
+/* Destroy a pool and every arena it holds */
+void sp_arena_pool_destroy(sp_arena_pool *pool) {
+    if (!pool) return;
+
+    for (size_t i = 0; i < pool->count; i++) {
+        sp_arena_destroy(pool->arenas[i]);
+    }
+
+#if SP_ARENA_THREAD_SAFE 
+    pthread_mutex_destroy(&pool->mutex);
+#endif
+    free(pool->arenas);
+    free(pool);
+}
+
+/* Thread local scratch arenas */
+#if SP_ARENA_THREAD_SAFE 
+static _Thread_local sp_arena *scratch_arenas[SP_ARENA_SCRATCH_COUNT];
+static pthread_key_t scratch_key;
+static pthread_once_t scratch_key_once = PTHREAD_ONCE_INIT;
+
+/* Thread exit destructor, the key's value is the exiting thread's scratch_arenas */
+static void scratch_destroy(void *arenas) {
+    sp_arena **scratch = arenas;
+    for (size_t i = 0; i < SP_ARENA_SCRATCH_COUNT; i++) {
+        sp_arena_destroy(scratch[i]);
+        scratch[i] = NULL;
+    }
+}
+
+static void scratch_key_create(void) {
+    pthread_key_create(&scratch_key, scratch_destroy);
+}
+#else
+static sp_arena *scratch_arenas[SP_ARENA_SCRATCH_COUNT];
+#endif
+
+static bool scratch_conflicts(const sp_arena *arena, sp_arena **conflicts, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        if (conflicts[i] == arena) return true;
+    }
+    return false;
+}
+
+/* Scratch arena of the calling thread that isn't one of the conflicts */
+static sp_arena *scratch_get(sp_arena **conflicts, size_t count) {
+    for (size_t i = 0; i < SP_ARENA_SCRATCH_COUNT; i++) {
+        sp_arena *arena = scratch_arenas[i];
+        if (arena && conflicts && scratch_conflicts(arena, conflicts, count)) continue;
+        if (arena) return arena;
+
+        // Unused slots can't conflict, fill them on first use 
+        sp_arena_config config = SP_ARENA_DEFAULT_CONFIG;
+        config.sync = SP_ARENA_SYNC_NONE;
+        arena = sp_arena_create_with_config(config);
+        if (!arena) return NULL;
+
+#if SP_ARENA_THREAD_SAFE 
+        pthread_once(&scratch_key_once, scratch_key_create);
+        pthread_setspecific(scratch_key, scratch_arenas);
+#endif
+        scratch_arenas[i] = arena;
+        return arena;
+    }
+    return NULL;
+}
+
+/* Begin a temporary scope on a scratch arena that isn't one of the conflicts */
+sp_arena_temp sp_arena_scratch_begin(sp_arena **conflicts, size_t count) {
+    return sp_arena_temp_begin(scratch_get(conflicts, count));
+}
+
+void sp_arena_scratch_end(sp_arena_temp scratch) {
+    sp_arena_temp_end(scratch);
+}
+
+/* Free the calling thread's scratch arenas */
+void sp_arena_scratch_release(void) {
+    for (size_t i = 0; i < SP_ARENA_SCRATCH_COUNT; i++) {
+        sp_arena_destroy(scratch_arenas[i]);
+        scratch_arenas[i] = NULL;
+    }
+}
+
+#undef SP_ARENA_SOURCE_
@@ -22,8 +22,15 @@
 #ifndef SP_ARENA_H_ 
 #define SP_ARENA_H_ 
 
+/* Single header mode compiles sp_arena.c here, its mmap flags and madvise are only declared 
+ * under -std=c17 when the feature macro precedes the first system header of the file */
+#if defined(SP_ARENA_IMPLEMENTATION) && !defined(_WIN32) && !defined(_DEFAULT_SOURCE)
+#define _DEFAULT_SOURCE
+#endif
+
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
 #include <stdbool.h>
 
 /* Data sizes */
@@ -50,14 +57,121 @@
 #define SP_ARENA_DEFAULT_DEALLOCATOR free
 #endif
 
+#ifndef SP_ARENA_DEFAULT_COMMIT_SIZE 
+#define SP_ARENA_DEFAULT_COMMIT_SIZE (KB(64))
+#endif
+
+/* Free bins for retained blocks, one per power of two size class */
+#define SP_ARENA_FREE_BINS 64
+
+/* Open temporary scopes tracked inside the arena struct before the stack moves to the heap */
+#ifndef SP_ARENA_INLINE_SCOPES 
+#define SP_ARENA_INLINE_SCOPES 16
+#endif
+
+#ifndef SP_ARENA_MAX_NUMA_NODES 
+#define SP_ARENA_MAX_NUMA_NODES 1024
+#endif
+
+#ifndef SP_ARENA_CACHE_LINE_SIZE 
+#define SP_ARENA_CACHE_LINE_SIZE 64
+#endif
+
+/* Start a struct member on its own cache line */
+#ifdef __cplusplus
+#define SP_ARENA_CACHE_ALIGNED alignas(SP_ARENA_CACHE_LINE_SIZE)
+#else
+#define SP_ARENA_CACHE_ALIGNED _Alignas(SP_ARENA_CACHE_LINE_SIZE)
+#endif
+
+#ifdef __cplusplus
+#define SP_ARENA_THREAD_LOCAL thread_local
+#else
+#define SP_ARENA_THREAD_LOCAL _Thread_local
+#endif
+
+/* Thread safety: 0 compiles out every lock along with pthreads, 1 builds the mutex and lock-free 
+ * modes with the mutex as default, 2 builds the same with the lock-free atomic bump as default */
 #ifndef SP_ARENA_THREAD_SAFE 
 #define SP_ARENA_THREAD_SAFE 1
 #endif
 
-#ifdef SP_ARENA_THREAD_SAFE
+/* Sync mode of SP_ARENA_DEFAULT_CONFIG, every arena can pick its own through config.sync */
+#ifndef SP_ARENA_DEFAULT_SYNC 
+#if !SP_ARENA_THREAD_SAFE
+#define SP_ARENA_DEFAULT_SYNC SP_ARENA_SYNC_NONE
+#elif SP_ARENA_THREAD_SAFE == 2
+#define SP_ARENA_DEFAULT_SYNC SP_ARENA_SYNC_ATOMIC
+#else
+#define SP_ARENA_DEFAULT_SYNC SP_ARENA_SYNC_MUTEX
+#endif
+#endif
+
+#ifndef SP_ARENA_DEFAULT_THREAD_CHUNK_SIZE 
+#define SP_ARENA_DEFAULT_THREAD_CHUNK_SIZE (KB(4))
+#endif
+
+#ifndef SP_ARENA_THREAD_CHUNK_SLOTS 
+#define SP_ARENA_THREAD_CHUNK_SLOTS 4
+#endif
+
+/* Scratch arenas per thread, two cover a function taking one arena and allocating a result in it */
+#ifndef SP_ARENA_SCRATCH_COUNT 
+#define SP_ARENA_SCRATCH_COUNT 2
+#endif
+
+/* Copies at least this large bypass the cache with non-temporal stores */
+#ifndef SP_ARENA_STREAM_THRESHOLD 
+#define SP_ARENA_STREAM_THRESHOLD (MB(1))
+#endif
+
+/* Bytes a slab allocator takes from its arena at a time */
+#ifndef SP_ARENA_SLAB_SIZE 
+#define SP_ARENA_SLAB_SIZE (KB(4))
+#endif
+
+/* Size classes of sp_arena_slab_classes, powers of two from 8 bytes up */
+#define SP_ARENA_SLAB_CLASSES 6
+
+#ifndef SP_ARENA_POISON_BYTE 
+#define SP_ARENA_POISON_BYTE 0xA5
+#endif
+
+/* Debug build: ASan poisoning of unused and rewound memory and redzones between allocations. 
+ * Inline allocation takes the slow path and lock-free modes fall back to the mutex */
+#ifndef SP_ARENA_DEBUG 
+#define SP_ARENA_DEBUG 0
+#endif
+
+/* Poisoned bytes after every allocation in debug builds */
+#ifndef SP_ARENA_DEBUG_REDZONE 
+#define SP_ARENA_DEBUG_REDZONE 16
+#endif
+
+/* Count allocations, alignment padding and lock contention, adds a few increments to the fast path */
+#ifndef SP_ARENA_STATS 
+#define SP_ARENA_STATS 0
+#endif
+
+/* Record per callsite allocation histograms through the allocation macros */
+#ifndef SP_ARENA_PROFILE 
+#define SP_ARENA_PROFILE 0
+#endif
+
+/* Callsites the profiler tracks, allocations from further callsites are not recorded */
+#ifndef SP_ARENA_PROFILE_SLOTS 
+#define SP_ARENA_PROFILE_SLOTS 256
+#endif
+
+#if SP_ARENA_THREAD_SAFE
 #include <pthread.h>
 #endif
 
+/* C++ can include this header, sp_arena.c itself is always compiled as C */
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 /* Common useful macros */
 #define Stmt(s) do { s } while (0);
 #define ArrayLen(a) (sizeof((a)) / sizeof(*(a)))
@@ -71,43 +185,163 @@ typedef enum {
     SP_ARENA_ERR_INVALID_SIZE, 
     SP_ARENA_ERR_INVALID_ARENA, 
     SP_ARENA_ERR_ARENA_NOT_ALLOCATED, 
-    SP_ARENA_ERR_ALLOCATION_TOO_LARGE
+    SP_ARENA_ERR_ALLOCATION_TOO_LARGE, 
+    SP_ARENA_ERR_READ_ONLY, 
+    SP_ARENA_ERR_SNAPSHOT
 } sp_arena_err_t;
 
+/* Synchronisation strategy of an arena, always SP_ARENA_SYNC_NONE when SP_ARENA_THREAD_SAFE is 0 */
+typedef enum {
+    SP_ARENA_SYNC_MUTEX = 0,        /* Every allocation takes the arena mutex */
+    SP_ARENA_SYNC_THREAD_CACHE,     /* Lock-free per-thread chunks, mutex only taken on refill */
+    SP_ARENA_SYNC_ATOMIC,           /* Lock-free CAS bump on the shared block, mutex only taken to add a block */
+    SP_ARENA_SYNC_NONE              /* No synchronisation, the arena is only ever used by one thread */
+} sp_arena_sync_t;
+
+/* NUMA placement of an arena's blocks */
+typedef enum {
+    SP_ARENA_NUMA_NONE = 0,         /* Leave placement to the OS */
+    SP_ARENA_NUMA_LOCAL,            /* Bind to the node of the thread creating the arena */
+    SP_ARENA_NUMA_NODE              /* Bind to config.numa_node */
+} sp_arena_numa_t;
+
+/* What sp_arena_clear, and sp_arena_temp_end for what it rewinds, do to the memory that was in use */
+typedef enum {
+    SP_ARENA_CLEAR_NONE = 0,        /* Leave old contents in place */
+    SP_ARENA_CLEAR_ZERO,            /* Zero it, so no data outlives the clear */
+    SP_ARENA_CLEAR_POISON           /* Fill it with SP_ARENA_POISON_BYTE to expose use after clear */
+} sp_arena_clear_mode_t;
+
 typedef struct sp_arena             sp_arena;
 typedef struct sp_arena_block       sp_arena_block;
 typedef struct sp_arena_config      sp_arena_config;
 typedef struct sp_arena_temp        sp_arena_temp;
+typedef struct sp_arena_pool        sp_arena_pool;
+typedef struct sp_arena_sb          sp_arena_sb;
+typedef struct sp_arena_slab        sp_arena_slab;
+typedef struct sp_arena_slab_classes sp_arena_slab_classes;
+typedef struct sp_arena_map         sp_arena_map;
 
-/* Arena block struct */
+/* Arena block header, stored at the start of the block's own allocation */
 struct sp_arena_block {
-    void *memory;                   /* Pointer to block's memory region */
-    size_t size;                    /* Size of block */
+    size_t size;                    /* Size of block's memory region */
     size_t used;                    /* Memory utilised */
     sp_arena_block *next;           /* Pointer to next block */
+    size_t idle_clears;             /* Clears spent unused in the free bins */
+    size_t dirty;                   /* Bytes past this offset are known to read as zero */
+    size_t limit;                   /* Offset the fast path bumps up to, below size while a prefetch is armed */
 };
 
+/* Size of the block header, the memory region starts on the next cache line */
+#define SP_ARENA_BLOCK_HEADER_SIZE \
+    ((sizeof(sp_arena_block) + SP_ARENA_CACHE_LINE_SIZE - 1) & ~(size_t)(SP_ARENA_CACHE_LINE_SIZE - 1))
+
+/* Pointer to a block's memory region, which directly follows its header */
+static inline char *sp_arena_block_memory(const sp_arena_block *block) {
+    return (char *)block + SP_ARENA_BLOCK_HEADER_SIZE;
+}
+
 /* Arena config struct */
 struct sp_arena_config {
-    size_t block_size;              /* Size of each block */
+    size_t block_size;              /* Size of each block allocation, including its header */
     size_t alignment;               /* Default alignment for allocations */
     bool fixed_size;                /* If true, don't allocate additional blocks (arena with fixed size)*/
     void *(*allocator)(size_t);     /* Custom allocator */
     void (*deallocator)(void*);      /* Custom deallocator */
+    sp_arena_sync_t sync;           /* Synchronisation strategy for thread safe arenas */
+    size_t thread_chunk_size;       /* Size of per-thread chunks (SP_ARENA_SYNC_THREAD_CACHE) */
+    size_t reserve_size;            /* If non-zero, reserve this much address space as one contiguous block */
+    size_t commit_size;             /* Granularity at which reserved pages are committed */
+    bool decommit_on_clear;         /* Give committed pages of a reserved arena back to the OS on clear */
+    size_t huge_page_size;          /* Back blocks with huge pages of this size (e.g. MB(2), GB(1)), 0 for regular pages */
+    sp_arena_numa_t numa_policy;    /* NUMA node binding of the arena's blocks */
+    int numa_node;                  /* Node to bind to with SP_ARENA_NUMA_NODE */
+    double growth_factor;           /* Each new block is this many times the last one, <= 1 for fixed block_size */
+    size_t max_block_size;          /* Upper bound on block growth, 0 for no bound */
+    size_t request_multiple;        /* Make a new block at least this many times the request that created it */
+    size_t large_threshold;         /* Requests this large that don't fit the current block get their own allocation,
+                                       0 for requests larger than a regular block */
+    size_t decay_clears;            /* Free retained blocks left unused for this many clears, 0 to keep them */
+    bool retain_large;              /* Keep large blocks for reuse on clear and rewind instead of freeing them */
+    bool zeroed_allocator;          /* config.allocator returns zeroed memory, like a calloc wrapper */
+    sp_arena_clear_mode_t clear_mode; /* What sp_arena_clear does to the memory that was in use */
+    bool isolate;                   /* Start every allocation on its own cache line to avoid false sharing */
+    bool guard_pages;               /* Map blocks from the OS with an inaccessible page after each one, 
+                                       not with huge pages */
+    double prefetch_watermark;      /* Fraction of the current block after which the next one is provisioned 
+                                       ahead of time, 0 to disable */
+    bool prefetch_populate;         /* Pre-fault the pages of prefetched blocks and commits */
+    bool prefetch_thread;           /* Provision prefetched blocks on a helper thread instead of the 
+                                       allocating one (thread safe sync modes only) */
 };
 
-/* Main arena struct */
+/* Snapshot of an arena's counters, returned by sp_arena_get_stats */
+typedef struct {
+    size_t total_allocated;         /* Memory allocated to the arena */
+    size_t total_used;              /* Memory used, padding included */
+    size_t peak_used;               /* Highest total_used sampled at clears, rewinds, resizes and stats calls */
+    size_t block_count;             /* Blocks held in use, retained or for large allocations */
+    size_t blocks_created;          /* Blocks the slow path had to create */
+    size_t tail_waste;              /* Bytes left at the end of blocks the arena moved past */
+    size_t allocations;             /* Allocations served (SP_ARENA_STATS only) */
+    size_t padding;                 /* Bytes lost to alignment padding (SP_ARENA_STATS only) */
+    size_t lock_contentions;        /* Lock acquisitions that had to wait (SP_ARENA_STATS only) */
+    uint64_t lock_wait_ns;          /* Time spent waiting for the lock (SP_ARENA_STATS only) */
+} sp_arena_stats;
+
+/* Main arena struct, laid out so the fields every allocation reads, the counters it 
+ * writes and the lock each get their own cache lines */
 struct sp_arena
 {   
-    sp_arena_block *first;          /* First block in list */
+    // Read by the fast path, written only when the arena changes block or epoch 
     sp_arena_block *current;        /* Current block being allocated from */
-    size_t total_allocated;         /* Total memory allocated to the arena */
-    size_t total_used;              /* Total memory used */
+    uint64_t epoch;                 /* Generation of per-thread chunks, bumped on clear/rewind */
+    size_t min_alignment;           /* Alignment every allocation gets at least */
+    sp_arena_block *first;          /* First block in list */
+    size_t reserved;                /* Reserved address space of a virtual memory arena, 0 otherwise */
+    size_t mapped;                  /* Size of the read only snapshot mapping, 0 otherwise */
+    size_t shared;                  /* Size of the shared mapping holding this arena, 0 otherwise */
+    size_t page_size;               /* Page granularity blocks are rounded to */
     sp_arena_config config;         /* Config for arena */
+
+    // Statistics, bumped by atomic mode allocations and read by stats calls 
+    SP_ARENA_CACHE_ALIGNED 
+    size_t total_used;              /* Total memory used */
+    size_t total_allocated;         /* Total memory allocated to the arena */
     sp_arena_err_t last_err;        /* Last error for arena */
+    size_t peak_used;               /* Highest total_used sampled before it was lowered, at growing resizes and sp_arena_get_stats */
+    size_t tail_waste;              /* Bytes left at the end of blocks the arena moved past */
+    size_t blocks_created;          /* Blocks created by the slow path, large ones included */
+#if SP_ARENA_STATS
+    size_t allocations;             /* Allocations served */
+    size_t padding;                 /* Bytes lost to alignment padding */
+    size_t lock_contentions;        /* Lock acquisitions that had to wait */
+    uint64_t lock_wait_ns;          /* Time spent waiting for the lock */
+#endif
 
-#ifdef SP_ARENA_THREAD_SAFE
+    // Slow path state, only touched with the lock held 
+#if SP_ARENA_THREAD_SAFE
+    SP_ARENA_CACHE_ALIGNED 
     pthread_mutex_t mutex;          /* Mutex for thread safe */
+#endif
+    sp_arena_block *large;          /* Large allocations with their own block, newest first */
+    sp_arena_block *pending;        /* Blocks rewound past by temp_end, moved to the free bins lazily */
+    size_t temp_depth;              /* Number of open temporary scopes */
+    uint64_t scope_serial;          /* Serial of the last temporary scope begun */
+    uint64_t *scope_heap;           /* Serials of the open scopes once they outgrow scope_inline */
+    size_t scope_capacity;          /* Serials scope_heap has room for */
+    uint64_t scope_inline[SP_ARENA_INLINE_SCOPES]; /* Serials of the open scopes, outermost first */
+    uint64_t clears;                /* Clears so far, layers on top drop stale pointers when it moves */
+    size_t next_block_size;         /* Size of the next block to create */
+    uint64_t free_mask;             /* Bit i set when free_bins[i] is non-empty */
+    sp_arena_block *free_bins[SP_ARENA_FREE_BINS]; /* Retained empty blocks, binned by log2 of their size */
+    sp_arena_block *prefetched;     /* Block provisioned ahead of the current one running out */
+#if SP_ARENA_THREAD_SAFE
+    pthread_t prefetcher;           /* Helper thread provisioning blocks (config.prefetch_thread) */
+    pthread_cond_t prefetch_cond;   /* Wakes the helper thread, waited on with the arena mutex */
+    bool prefetch_running;          /* Helper thread was started */
+    bool prefetch_wanted;           /* The current block passed the watermark */
+    bool prefetch_stop;             /* Helper thread should exit */
 #endif
 };
 
@@ -117,8 +351,90 @@ struct sp_arena_temp {
     sp_arena_block *block;          /* Block at beginning of temporary scope */
     size_t used;                    /* Used amount at beginning of temporary scope */
     size_t total_used;              /* Total used amount at beginning of scope */
+    sp_arena_block *large;          /* Newest large allocation at beginning of scope */
+    size_t depth;                   /* Nesting depth of this scope, 1 for the outermost */
+    uint64_t serial;                /* Identity of this scope, stale once it or an enclosing scope ended */
+};
+
+/* Pool of cleared arenas recycled across short lived workloads */
+struct sp_arena_pool {
+    sp_arena_config config;         /* Config new arenas are created with */
+    sp_arena **arenas;              /* Stack of cleared arenas ready for reuse */
+    size_t count;                   /* Arenas currently in the pool */
+    size_t max_arenas;              /* Most arenas the pool keeps */
+    size_t max_retained;            /* Most bytes an arena keeps when released, 0 for no limit */
+
+#if SP_ARENA_THREAD_SAFE
+    pthread_mutex_t mutex;          /* Mutex for thread safe */
+#endif
 };
 
+/* String builder growing inside an arena */
+struct sp_arena_sb {
+    sp_arena *arena;                /* Arena the string lives in */
+    char *data;                     /* NUL terminated contents, NULL until the first append */
+    size_t len;                     /* Length excluding the terminator */
+    size_t cap;                     /* Bytes reserved for the contents and the terminator */
+};
+
+/* Slab allocator recycling fixed size objects through an intrusive free list */
+struct sp_arena_slab {
+    sp_arena *arena;                /* Arena slabs are taken from */
+    size_t object_size;             /* Size of each object, room for a free list link included */
+    size_t alignment;               /* Alignment of each object */
+    void *free_list;                /* Freed objects, each holding a pointer to the next */
+    char *cursor;                   /* Next unused object of the newest slab */
+    char *end;                      /* End of the newest slab */
+    uint64_t clears;                /* arena->clears the free list and slabs belong to */
+    size_t depth;                   /* Depth of the scope the newest slab was taken in, 0 for none */
+    uint64_t serial;                /* Serial of that scope, the slabs live until it ends */
+};
+
+/* Slab allocators for the power of two sizes from 8 to 256 bytes */
+struct sp_arena_slab_classes {
+    sp_arena *arena;                /* Arena requests above the largest class go to */
+    sp_arena_slab classes[SP_ARENA_SLAB_CLASSES]; /* One slab allocator per size class */
+};
+
+/* Entry of an arena hash map, entries are stored densely in insertion order */
+typedef struct {
+    const char *key;                /* Copy of the key in the arena, always NUL terminated */
+    size_t key_len;                 /* Length of the key in bytes */
+    uint64_t hash;                  /* Hash of the key */
+    void *value;                    /* Value stored for the key */
+} sp_arena_map_entry;
+
+/* Open addressing hash map with string keys, probed 16 control bytes at a time */
+struct sp_arena_map {
+    sp_arena *arena;                /* Arena keys, entries and the index live in */
+    sp_arena_map_entry *entries;    /* Entries in insertion order */
+    size_t count;                   /* Number of entries */
+    size_t entry_cap;               /* Capacity of the entries array */
+    uint8_t *ctrl;                  /* Control byte per slot, 7 bits of hash or empty */
+    uint32_t *slots;                /* Entry index per slot */
+    size_t capacity;                /* Number of slots, a power of two multiple of 16 */
+};
+
+#if SP_ARENA_THREAD_SAFE 
+/* Per-thread chunk carved from an arena block (SP_ARENA_SYNC_THREAD_CACHE) */
+typedef struct {
+    const sp_arena *arena;          /* Arena the chunk was carved from */
+    uint64_t epoch;                 /* Arena epoch the chunk is valid for */
+    char *cursor;                   /* Next free byte in the chunk */
+    char *end;                      /* One past the last byte of the chunk */
+} sp_arena_thread_chunk;
+
+extern SP_ARENA_THREAD_LOCAL sp_arena_thread_chunk sp_arena_thread_chunks[SP_ARENA_THREAD_CHUNK_SLOTS];
+
+/* Find the calling thread's chunk for an arena epoch */
+static inline sp_arena_thread_chunk *sp_arena_thread_chunk_find(uint64_t epoch) {
+    for (size_t i = 0; i < SP_ARENA_THREAD_CHUNK_SLOTS; i++) {
+        if (sp_arena_thread_chunks[i].epoch == epoch) return &sp_arena_thread_chunks[i];
+    }
+    return NULL;
+}
+#endif
+
 /* Default arena config */
 extern const sp_arena_config SP_ARENA_DEFAULT_CONFIG;
 
@@ -140,26 +456,210 @@ sp_arena* sp_arena_create(void);
 sp_arena* sp_arena_create_with_config(sp_arena_config config);
 
 /**
- * Allocate memory from an arena.
+ * Map a snapshot written by sp_arena_snapshot_write back as a read only arena.
+ * Its contents are at the same offsets they were written from and keep their alignment 
+ * up to the page size, allocating, resizing, clearing or rewinding the arena fails with 
+ * SP_ARENA_ERR_READ_ONLY.
+ * 
+ * @param path Snapshot file
+ * @return Pointer to the read only arena, or NULL if the file isn't a valid snapshot
+ */
+sp_arena* sp_arena_create_from_snapshot(const char *path);
+
+/**
+ * Create an arena in memory shared with processes forked after it. The arena struct and 
+ * a single block of config.block_size bytes live in the shared mapping, so every process 
+ * sees the same allocations at the same addresses. Locking uses a process shared mutex, 
+ * or the atomic bump with SP_ARENA_SYNC_ATOMIC, and SP_ARENA_SYNC_NONE leaves it to the 
+ * caller. Builds with SP_ARENA_THREAD_SAFE=0 have no lock, they only accept 
+ * SP_ARENA_SYNC_NONE. Each process calls sp_arena_destroy to unmap it, the memory is 
+ * released with the last mapping.
+ * 
+ * @param config Configuration, block_size is the fixed capacity
+ * @return Pointer to the shared arena, or NULL on failure, with SP_ARENA_SYNC_THREAD_CACHE, 
+ *         or without thread safety unless config.sync is SP_ARENA_SYNC_NONE
+ */
+sp_arena* sp_arena_create_shared(sp_arena_config config);
+
+/**
+ * Write the used bytes of a single block or virtual memory arena to a file. Pointers 
+ * inside the data should be stored as offsets (sp_arena_offset_of) to survive the move.
+ * 
+ * @param arena Arena to write, must have one block and no large allocations
+ * @param path File to write
+ * @return true on success, false on failure with the arena's error set
+ */
+bool sp_arena_snapshot_write(sp_arena *arena, const char *path);
+
+/**
+ * Offset of a pointer into the arena's first block, stable across snapshots.
+ * 
+ * @param arena Pointer to the arena
+ * @param ptr Pointer into the first block, or NULL
+ * @return The offset, 0 for NULL
+ */
+size_t sp_arena_offset_of(const sp_arena *arena, const void *ptr);
+
+/**
+ * Pointer for an offset returned by sp_arena_offset_of.
+ * 
+ * @param arena Pointer to the arena
+ * @param offset Offset into the first block, or 0
+ * @return The pointer, NULL for offset 0
+ */
+void *sp_arena_ptr_at(const sp_arena *arena, size_t offset);
+
+/* Count an allocation for sp_arena_get_stats, compiled out without SP_ARENA_STATS */
+static inline void sp_arena_count_alloc(sp_arena *arena, size_t padding) {
+#if SP_ARENA_STATS
+#if SP_ARENA_THREAD_SAFE 
+    // Lock-free modes count from several threads at once 
+    if (arena->config.sync == SP_ARENA_SYNC_ATOMIC || arena->config.sync == SP_ARENA_SYNC_THREAD_CACHE) {
+        __atomic_fetch_add(&arena->allocations, 1, __ATOMIC_RELAXED);
+        __atomic_fetch_add(&arena->padding, padding, __ATOMIC_RELAXED);
+        return;
+    }
+#endif
+    arena->allocations++;
+    arena->padding += padding;
+#else
+    Unused(arena)
+    Unused(padding)
+#endif
+}
+
+/**
+ * Allocation slow path: validation, locking, moving to a new block and error reporting.
+ * Called by the inline allocation functions when their fast path can't serve a request.
  * 
  * @param arena Pointer to the arena to allocate from
  * @param size Size of the allocation in bytes
+ * @param alignment Alignment of the allocation (must be a power of 2)
  * @return Pointer to the allocated memory, or NULL on failure
  */
-void *sp_arena_alloc(sp_arena *arena, size_t size);
+void *sp_arena_alloc_slow(sp_arena *arena, size_t size, size_t alignment);
 
 /**
  * Allocate memory from an arena with a specific alignment.
  * 
+ * The bump inside the current block (or the calling thread's chunk) is inlined,
+ * everything else is left to sp_arena_alloc_slow. Arenas using SP_ARENA_SYNC_MUTEX
+ * always take the slow path when thread safety is enabled, SP_ARENA_SYNC_NONE arenas
+ * bump without any synchronisation.
+ * 
  * @param arena Pointer to the arena to allocate from
  * @param size Size of the allocation in bytes
  * @param alignment Alignment of the allocation (must be a power of 2)
  * @return Pointer to the allocated memory, or NULL on failure
  */
-void *sp_arena_alloc_aligned(sp_arena *arena, size_t size, size_t alignment);
+static inline void *sp_arena_alloc_aligned(sp_arena *arena, size_t size, size_t alignment) {
+#if SP_ARENA_DEBUG
+    // Every allocation is poisoned and unpoisoned by the slow path 
+    return sp_arena_alloc_slow(arena, size, alignment);
+#endif
+    if (arena && size != 0 && alignment != 0 && (alignment & (alignment - 1)) == 0) {
+        if (alignment < arena->min_alignment) alignment = arena->min_alignment;
+        uintptr_t mask = (uintptr_t)alignment - 1;
+#if SP_ARENA_THREAD_SAFE 
+        if (arena->config.sync == SP_ARENA_SYNC_THREAD_CACHE) {
+            sp_arena_thread_chunk *chunk = sp_arena_thread_chunk_find(__atomic_load_n(&arena->epoch, __ATOMIC_ACQUIRE));
+            if (chunk) {
+                uintptr_t aligned = ((uintptr_t)chunk->cursor + mask) & ~mask;
+                if (aligned <= (uintptr_t)chunk->end && (uintptr_t)chunk->end - aligned >= size) {
+                    sp_arena_count_alloc(arena, aligned - (uintptr_t)chunk->cursor);
+                    chunk->cursor = (char *)(aligned + size);
+                    return (void *)aligned;
+                }
+            }
+        } else if (arena->config.sync == SP_ARENA_SYNC_ATOMIC) {
+            sp_arena_block *block = __atomic_load_n(&arena->current, __ATOMIC_ACQUIRE);
+            if (block) {
+                uintptr_t memory = (uintptr_t)sp_arena_block_memory(block);
+                size_t used = __atomic_load_n(&block->used, __ATOMIC_RELAXED);
+                size_t aligned_used = ((memory + used + mask) & ~mask) - memory;
+                size_t limit = __atomic_load_n(&block->limit, __ATOMIC_ACQUIRE);
+                if (aligned_used <= limit && size <= limit - aligned_used &&
+                    __atomic_compare_exchange_n(&block->used, &used, aligned_used + size, false,
+                                                __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                    __atomic_fetch_add(&arena->total_used, aligned_used + size - used, __ATOMIC_RELAXED);
+                    sp_arena_count_alloc(arena, aligned_used - used);
+                    return (void *)(memory + aligned_used);
+                }
+            }
+        } else if (arena->config.sync == SP_ARENA_SYNC_NONE)
+#endif
+        {
+            sp_arena_block *block = arena->current;
+            if (block) {
+                uintptr_t memory = (uintptr_t)sp_arena_block_memory(block);
+                size_t aligned_used = ((memory + block->used + mask) & ~mask) - memory;
+                if (aligned_used <= block->limit && size <= block->limit - aligned_used) {
+                    sp_arena_count_alloc(arena, aligned_used - block->used);
+                    arena->total_used += aligned_used + size - block->used;
+                    block->used = aligned_used + size;
+                    return (void *)(memory + aligned_used);
+                }
+            }
+        }
+    }
+    return sp_arena_alloc_slow(arena, size, alignment);
+}
+
+/**
+ * Allocate memory from an arena.
+ * 
+ * @param arena Pointer to the arena to allocate from
+ * @param size Size of the allocation in bytes
+ * @return Pointer to the allocated memory, or NULL on failure
+ */
+static inline void *sp_arena_alloc(sp_arena *arena, size_t size) {
+    return sp_arena_alloc_aligned(arena, size, arena ? arena->config.alignment : SP_ARENA_DEFAULT_ALIGNMENT);
+}
+
+/**
+ * Allocate several pieces back to back with a single allocation from the arena.
+ * 
+ * @param arena Pointer to the arena to allocate from
+ * @param sizes Size of each piece in bytes, pieces may be empty
+ * @param aligns Alignment of each piece (powers of 2), or NULL for the arena's default alignment
+ * @param out Receives a pointer to each piece
+ * @param count Number of pieces
+ * @return Pointer to the first piece, or NULL on failure
+ */
+void *sp_arena_alloc_batch(sp_arena *arena, const size_t *sizes, const size_t *aligns, void **out, size_t count);
+
+/**
+ * Allocate a struct of arrays, one array of `length` elements per field, in a single allocation.
+ * 
+ * @param arena Pointer to the arena to allocate from
+ * @param length Number of elements in every array
+ * @param elem_sizes Element size of each array
+ * @param elem_aligns Element alignment of each array, or NULL for natural alignment of the element size
+ * @param out Receives a pointer to each array
+ * @param count Number of arrays
+ * @return Pointer to the first array, or NULL on failure
+ */
+void *sp_arena_alloc_soa(sp_arena *arena, size_t length, const size_t *elem_sizes, const size_t *elem_aligns, 
+                         void **out, size_t count);
+
+/**
+ * Allocate memory on cache lines of its own, so objects handed to different threads 
+ * don't share a line with neighbouring allocations.
+ * 
+ * @param arena Pointer to the arena to allocate from
+ * @param size Size of the allocation in bytes, padded to a multiple of SP_ARENA_CACHE_LINE_SIZE
+ * @return Pointer to the cache line aligned memory, or NULL on failure
+ */
+static inline void *sp_arena_alloc_isolated(sp_arena *arena, size_t size) {
+    size_t padded = (size + SP_ARENA_CACHE_LINE_SIZE - 1) & ~(size_t)(SP_ARENA_CACHE_LINE_SIZE - 1);
+    if (padded < size) return sp_arena_alloc_slow(arena, size, SP_ARENA_CACHE_LINE_SIZE);
+    return sp_arena_alloc_aligned(arena, padded, SP_ARENA_CACHE_LINE_SIZE);
+}
 
 /**
  * Allocate and zero-initialize memory from an arena.
+ * Only bytes dirtied before a clear or rewind are cleared, memory fresh from the OS or 
+ * from a zeroed_allocator is left alone. Thread cache and atomic arenas clear everything.
  * 
  * @param arena Pointer to the arena to allocate from
  * @param size Size of the allocation in bytes
@@ -179,8 +679,67 @@ void *sp_arena_calloc(sp_arena *arena, size_t size);
  */
 void *sp_arena_resize(sp_arena *arena, void *old_ptr, size_t old_size, size_t new_size); 
 
+/**
+ * Resize an allocation made from an arena, the allocation moves to memory with the 
+ * given alignment when it can't be resized in place.
+ * 
+ * @param arena Pointer to the arena
+ * @param old_ptr Pointer to the existing allocation
+ * @param old_size Size of the existing allocation
+ * @param new_size New size for the allocation
+ * @param alignment Alignment of the allocation (must be a power of 2)
+ * @return Pointer to the resized allocation, or NULL on failure
+ */
+void *sp_arena_resize_aligned(sp_arena *arena, void *old_ptr, size_t old_size, size_t new_size, size_t alignment);
+
+/**
+ * Take the arena lock, so a run of _unlocked calls pays for it once. The lock is not 
+ * recursive, only _unlocked functions may be called on the arena until sp_arena_unlock.
+ * 
+ * @param arena Pointer to the arena to lock
+ */
+void sp_arena_lock(sp_arena *arena);
+
+/**
+ * Release the arena lock taken by sp_arena_lock.
+ * 
+ * @param arena Pointer to the arena to unlock
+ */
+void sp_arena_unlock(sp_arena *arena);
+
+/**
+ * Allocate memory from an arena whose lock the caller holds.
+ * 
+ * @param arena Pointer to the locked arena
+ * @param size Size of the allocation in bytes
+ * @return Pointer to the allocated memory, or NULL on failure
+ */
+void *sp_arena_alloc_unlocked(sp_arena *arena, size_t size);
+
+/**
+ * Allocate aligned memory from an arena whose lock the caller holds.
+ * 
+ * @param arena Pointer to the locked arena
+ * @param size Size of the allocation in bytes
+ * @param alignment Alignment of the allocation (must be a power of 2)
+ * @return Pointer to the allocated memory, or NULL on failure
+ */
+void *sp_arena_alloc_aligned_unlocked(sp_arena *arena, size_t size, size_t alignment);
+
+/**
+ * Resize an allocation made from an arena whose lock the caller holds.
+ * 
+ * @param arena Pointer to the locked arena
+ * @param old_ptr Pointer to the existing allocation
+ * @param old_size Size of the existing allocation
+ * @param new_size New size for the allocation
+ * @return Pointer to the resized allocation, or NULL on failure
+ */
+void *sp_arena_resize_unlocked(sp_arena *arena, void *old_ptr, size_t old_size, size_t new_size);
+
 /**
  * Allocate and copy a string into an arena.
+ * The string is measured while it is copied into the free tail of the current block.
  * 
  * @param arena Pointer to the arena
  * @param str String to duplicate
@@ -189,15 +748,216 @@ void *sp_arena_resize(sp_arena *arena, void *old_ptr, size_t old_size, size_t ne
 char *sp_arena_strdup(sp_arena *arena, const char *str);
 
 /**
- * Create a temporary checkpoint for the arena that can be rewound later.
+ * Allocate and copy at most n bytes of a string into an arena, always NUL terminated.
  * 
  * @param arena Pointer to the arena
- * @return Temporary arena scope object
+ * @param str String to duplicate
+ * @param n Most bytes to copy from str
+ * @return Pointer to the duplicated string, or NULL on failure
+ */
+char *sp_arena_strndup(sp_arena *arena, const char *str, size_t n);
+
+/**
+ * Allocate and copy a memory region into an arena. Copies of SP_ARENA_STREAM_THRESHOLD 
+ * bytes or more are cache line aligned and written with non-temporal stores.
+ * 
+ * @param arena Pointer to the arena
+ * @param src Memory to copy
+ * @param size Number of bytes to copy
+ * @return Pointer to the copy, or NULL on failure
+ */
+void *sp_arena_memdup(sp_arena *arena, const void *src, size_t size);
+
+/**
+ * Grow an arena backed array to hold at least min_cap elements. The array grows in 
+ * place while it is the arena's last allocation, otherwise its capacity doubles and 
+ * the contents are copied. Used by the sp_arena_vec macros.
+ * 
+ * @param arena Pointer to the arena
+ * @param data Current array, or NULL for none
+ * @param cap Capacity of the array in elements, updated on success
+ * @param min_cap Capacity needed
+ * @param elem_size Size of one element
+ * @return The array's new location, or data with cap unchanged on failure
+ */
+void *sp_arena_vec_grow(sp_arena *arena, void *data, size_t *cap, size_t min_cap, size_t elem_size);
+
+/**
+ * Start an empty string builder in an arena.
+ * 
+ * @param sb String builder to initialise
+ * @param arena Arena the string is built in
+ */
+void sp_arena_sb_init(sp_arena_sb *sb, sp_arena *arena);
+
+/**
+ * Append bytes to a string builder.
+ * 
+ * @param sb String builder
+ * @param str Bytes to append
+ * @param len Number of bytes
+ * @return true on success, false if the arena ran out of memory
+ */
+bool sp_arena_sb_append(sp_arena_sb *sb, const char *str, size_t len);
+
+/**
+ * Append printf style formatted text to a string builder.
+ * 
+ * @param sb String builder
+ * @param fmt Format string
+ * @return true on success, false on a formatting error or if the arena ran out of memory
+ */
+bool sp_arena_sb_appendf(sp_arena_sb *sb, const char *fmt, ...);
+
+/**
+ * Get the NUL terminated contents of a string builder.
+ * 
+ * @param sb String builder
+ * @return The string, which stays valid as long as the arena memory it lives in
+ */
+const char *sp_arena_sb_cstr(const sp_arena_sb *sb);
+
+/**
+ * Create a slab allocator for objects of one size. Objects are recycled through a free 
+ * list until the arena is cleared or the scope the newest slab was taken in ends, which 
+ * drops them all at once. Scopes opened and ended after that leave the slab alone.
+ * A slab allocator is not thread safe.
+ * 
+ * @param arena Arena slabs are taken from
+ * @param object_size Size of each object
+ * @param alignment Alignment of each object (must be a power of 2)
+ * @return The slab allocator, allocations fail if the arguments are invalid
+ */
+sp_arena_slab sp_arena_slab_create(sp_arena *arena, size_t object_size, size_t alignment);
+
+/**
+ * Allocate one object, reusing a freed one when there is one.
+ * 
+ * @param slab Slab allocator
+ * @return Pointer to the object, or NULL on failure
+ */
+void *sp_arena_slab_alloc(sp_arena_slab *slab);
+
+/**
+ * Give an object back to its slab allocator for reuse.
+ * 
+ * @param slab Slab allocator the object came from
+ * @param ptr Object to free, may be NULL
+ */
+void sp_arena_slab_free(sp_arena_slab *slab, void *ptr);
+
+/**
+ * Start slab allocators for the size classes 8, 16, 32, 64, 128 and 256 bytes.
+ * 
+ * @param classes Size classes to initialise
+ * @param arena Arena slabs are taken from
+ */
+void sp_arena_slab_classes_init(sp_arena_slab_classes *classes, sp_arena *arena);
+
+/**
+ * Allocate from the smallest size class that fits. Larger requests come straight 
+ * from the arena and are only released by clearing it.
+ * 
+ * @param classes Size classes
+ * @param size Size of the allocation in bytes
+ * @return Pointer to the allocated memory, or NULL on failure
+ */
+void *sp_arena_slab_classes_alloc(sp_arena_slab_classes *classes, size_t size);
+
+/**
+ * Give memory back to its size class.
+ * 
+ * @param classes Size classes the memory came from
+ * @param ptr Memory to free, may be NULL
+ * @param size Size it was allocated with
+ */
+void sp_arena_slab_classes_free(sp_arena_slab_classes *classes, void *ptr, size_t size);
+
+/**
+ * Start an empty hash map in an arena. Entries can't be removed one by one, the map is 
+ * rewound with sp_arena_map_rewind or dropped with its arena. A map is not thread safe.
+ * 
+ * @param map Map to initialise
+ * @param arena Arena the map lives in
+ */
+void sp_arena_map_init(sp_arena_map *map, sp_arena *arena);
+
+/**
+ * Make room for count entries, so inserting them doesn't move the map's arrays.
+ * 
+ * @param map Map
+ * @param count Number of entries
+ * @return true on success, false if the arena ran out of memory
+ */
+bool sp_arena_map_reserve(sp_arena_map *map, size_t count);
+
+/**
+ * Find the entry for a key.
+ * 
+ * @param map Map
+ * @param key Key bytes
+ * @param len Length of the key
+ * @return The entry, or NULL if the key isn't in the map
+ */
+sp_arena_map_entry *sp_arena_map_find(const sp_arena_map *map, const void *key, size_t len);
+
+/**
+ * Find the entry for a key, inserting it with a NULL value if it is missing. 
+ * Entry pointers stay valid until the next insertion.
+ * 
+ * @param map Map
+ * @param key Key bytes, copied into the arena on insertion
+ * @param len Length of the key
+ * @return The entry, or NULL if the arena ran out of memory
+ */
+sp_arena_map_entry *sp_arena_map_insert(sp_arena_map *map, const void *key, size_t len);
+
+/**
+ * Set the value of a key, inserting it if it is missing.
+ * 
+ * @param map Map
+ * @param key Key bytes
+ * @param len Length of the key
+ * @param value Value to store
+ * @return true on success, false if the arena ran out of memory
+ */
+bool sp_arena_map_put(sp_arena_map *map, const void *key, size_t len, void *value);
+
+/**
+ * Drop every entry inserted after the map had `count` entries. Use it before the 
+ * sp_arena_temp_end of a scope the keys were inserted in, the map's arrays must 
+ * predate the scope (see sp_arena_map_reserve).
+ * 
+ * @param map Map
+ * @param count Number of entries to keep, a previous value of map->count
+ */
+void sp_arena_map_rewind(sp_arena_map *map, size_t count);
+
+/**
+ * Intern a string: equal strings give the same pointer.
+ * 
+ * @param map Map used as the intern table
+ * @param str String bytes
+ * @param len Length of the string
+ * @return The canonical NUL terminated copy, or NULL if the arena ran out of memory
+ */
+const char *sp_arena_intern(sp_arena_map *map, const char *str, size_t len);
+
+/**
+ * Create a temporary checkpoint for the arena that can be rewound later. The arena 
+ * keeps the serials of its open scopes outside of arena memory, telling open scopes 
+ * from ended ones, so beginning a scope never takes arena bytes. Shared arenas track 
+ * at most SP_ARENA_INLINE_SCOPES open scopes since the heap is private to each process.
+ * 
+ * @param arena Pointer to the arena
+ * @return Temporary arena scope object, its block is NULL if the scope couldn't be created
  */
 sp_arena_temp sp_arena_temp_begin(sp_arena *arena);
 
 /**
- * Rewind an arena to a previous state.
+ * Rewind an arena to a previous state. Blocks filled after the checkpoint are kept 
+ * for reuse, ending an outer scope also ends every scope opened inside it. Ending a 
+ * scope that already ended, directly, through an enclosing scope or by a clear, does nothing.
  * 
  * @param temp Temporary arena scope to rewind to
  */
@@ -210,6 +970,15 @@ void sp_arena_temp_end(sp_arena_temp temp);
  */
 void sp_arena_clear(sp_arena *arena);
 
+/**
+ * Free retained blocks, largest first, until the arena holds at most keep_bytes.
+ * Blocks in use and the first block are kept, reserved arenas decommit their unused pages.
+ * 
+ * @param arena Pointer to the arena to trim
+ * @param keep_bytes Target for the arena's total allocated memory
+ */
+void sp_arena_trim(sp_arena *arena, size_t keep_bytes);
+
 /**
  * Free all memory associated with an arena.
  * 
@@ -258,30 +1027,273 @@ size_t sp_arena_total_used(const sp_arena *arena);
 float sp_arena_utilization(const sp_arena *arena);
 
 /**
- * Get the report of memory utilisation by arena. 
+ * Get the report of memory utilisation by arena. It gathers the counters with 
+ * sp_arena_get_stats, which takes the arena lock.
  * 
  * @param arena Pointer to the arena 
  */
-void sp_arena_usage_report(const sp_arena *arena);
+void sp_arena_usage_report(sp_arena *arena);
+
+/**
+ * Get the arena's counters. Allocation, padding and lock counters stay 0 unless the 
+ * library is built with SP_ARENA_STATS.
+ * 
+ * @param arena Pointer to the arena
+ * @return Snapshot of the counters, all 0 for NULL
+ */
+sp_arena_stats sp_arena_get_stats(sp_arena *arena);
+
+#if SP_ARENA_PROFILE
+/* Allocations recorded for one callsite */
+typedef struct {
+    const char *file;               /* __FILE__ of the callsite */
+    int line;                       /* __LINE__ of the callsite */
+    size_t count;                   /* Allocations made */
+    size_t requested;               /* Bytes requested */
+    size_t consumed;                /* Bytes the arena's used total grew by, approximate under concurrent use */
+} sp_arena_callsite;
+
+/**
+ * Record an allocation for a callsite, called by the profiling allocation macros.
+ * 
+ * @param file Source file of the callsite
+ * @param line Source line of the callsite
+ * @param requested Bytes requested
+ * @param consumed Bytes the arena's used total grew by
+ */
+void sp_arena_profile_record(const char *file, int line, size_t requested, size_t consumed);
+
+/**
+ * Copy the recorded callsites, most consumed bytes first.
+ * 
+ * @param out Receives the callsites
+ * @param max Capacity of out
+ * @return Number of callsites copied
+ */
+size_t sp_arena_profile_callsites(sp_arena_callsite *out, size_t max);
+
+/* Print the recorded callsites, most consumed bytes first */
+void sp_arena_profile_report(void);
+
+/* Forget every recorded callsite */
+void sp_arena_profile_reset(void);
+
+/* Allocate and record the callsite, the targets of the profiling macros */
+static inline void *sp_arena_profile_alloc_aligned(sp_arena *arena, size_t size, size_t alignment, 
+                                                   const char *file, int line) {
+    size_t before = sp_arena_total_used(arena);
+    void *ptr = sp_arena_alloc_aligned(arena, size, alignment);
+    if (ptr) sp_arena_profile_record(file, line, size, sp_arena_total_used(arena) - before);
+    return ptr;
+}
+
+static inline void *sp_arena_profile_alloc(sp_arena *arena, size_t size, const char *file, int line) {
+    return sp_arena_profile_alloc_aligned(arena, size, arena ? arena->config.alignment : SP_ARENA_DEFAULT_ALIGNMENT, 
+                                          file, line);
+}
+
+static inline void *sp_arena_profile_calloc(sp_arena *arena, size_t size, const char *file, int line) {
+    size_t before = sp_arena_total_used(arena);
+    void *ptr = sp_arena_calloc(arena, size);
+    if (ptr) sp_arena_profile_record(file, line, size, sp_arena_total_used(arena) - before);
+    return ptr;
+}
+#endif
+
+/**
+ * Create a pool of recycled arenas.
+ * 
+ * @param config Configuration of the arenas the pool creates
+ * @param max_arenas Most arenas kept in the pool, extra released arenas are destroyed
+ * @param max_retained Most bytes a released arena keeps, 0 for no limit
+ * @return Pointer to the pool, or NULL on failure
+ */
+sp_arena_pool *sp_arena_pool_create(sp_arena_config config, size_t max_arenas, size_t max_retained);
+
+/**
+ * Create arenas up front so later acquires are a pointer pop.
+ * 
+ * @param pool Pointer to the pool
+ * @param count Number of arenas to add
+ * @return Number of arenas added
+ */
+size_t sp_arena_pool_prewarm(sp_arena_pool *pool, size_t count);
+
+/**
+ * Take a cleared arena from the pool, or create one if the pool is empty.
+ * 
+ * @param pool Pointer to the pool
+ * @return Pointer to the arena, or NULL on failure
+ */
+sp_arena *sp_arena_pool_acquire(sp_arena_pool *pool);
+
+/**
+ * Clear an arena, trim it to the pool's retention limit and hand it back.
+ * The arena is destroyed if the pool is full.
+ * 
+ * @param pool Pointer to the pool
+ * @param arena Arena to release
+ */
+void sp_arena_pool_release(sp_arena_pool *pool, sp_arena *arena);
+
+/**
+ * Destroy a pool and every arena in it.
+ * 
+ * @param pool Pointer to the pool
+ */
+void sp_arena_pool_destroy(sp_arena_pool *pool);
+
+/**
+ * Begin a temporary scope on one of the calling thread's scratch arenas.
+ * The scratch arena picked is none of the conflicting arenas, so a function can take 
+ * scratch memory while it allocates results in an arena it was handed. Scratch arenas 
+ * are created on first use with SP_ARENA_SYNC_NONE and freed when the thread exits.
+ * 
+ * @param conflicts Arenas the scratch memory must not come from, may be NULL
+ * @param count Number of conflicting arenas
+ * @return Temporary scope whose arena is the scratch arena, its block is NULL on failure
+ */
+sp_arena_temp sp_arena_scratch_begin(sp_arena **conflicts, size_t count);
+
+/**
+ * Rewind a scratch arena to where sp_arena_scratch_begin found it.
+ * 
+ * @param scratch Scope returned by sp_arena_scratch_begin
+ */
+void sp_arena_scratch_end(sp_arena_temp scratch);
+
+/**
+ * Free the calling thread's scratch arenas before it exits.
+ * Every scratch scope of the thread must have ended.
+ */
+void sp_arena_scratch_release(void);
+
+/* Natural alignment of a type */
+#ifdef __cplusplus
+#define SP_ARENA_ALIGNOF(type) alignof(type)
+#else
+#define SP_ARENA_ALIGNOF(type) _Alignof(type)
+#endif
+
+/* Convert an allocation's void * to the type of `lvalue`, C does it implicitly */
+#ifdef __cplusplus
+#define SP_ARENA_CAST_AS(lvalue, ptr) static_cast<decltype(lvalue)>(ptr)
+#else
+#define SP_ARENA_CAST_AS(lvalue, ptr) (ptr)
+#endif
+
+/**
+ * Allocate an array of `count` elements of `size` bytes each, checking the total
+ * for overflow. With constant size and alignment the checks and alignment mask fold.
+ * 
+ * @param arena Pointer to the arena to allocate from
+ * @param size Size of each element in bytes
+ * @param count Number of elements
+ * @param alignment Alignment of the allocation (must be a power of 2)
+ * @return Pointer to the allocated memory, or NULL on failure
+ */
+static inline void *sp_arena_alloc_array_aligned(sp_arena *arena, size_t size, size_t count, size_t alignment) {
+    if (size != 0 && count > SIZE_MAX / size) {
+        if (arena) arena->last_err = SP_ARENA_ERR_ALLOCATION_TOO_LARGE;
+        return NULL;
+    }
+    return sp_arena_alloc_aligned(arena, size * count, alignment);
+}
 
 /**
  * Helper macro to allocate an object of a specific type.
+ * Uses the natural alignment of the type rather than the arena's default alignment.
  */
-#define sp_arena_alloc_type(arena, type) ((type*) sp_arena_alloc(arena, sizeof(type)))
+#define sp_arena_alloc_type(arena, type) \
+    ((type*) sp_arena_alloc_aligned(arena, sizeof(type), SP_ARENA_ALIGNOF(type)))
 
 /**
  * Helper macro to allocate an array of objects of a specific type.
+ * Uses the natural alignment of the type rather than the arena's default alignment.
  */
-#define sp_arena_alloc_array(arena, type, count) ((type*) sp_arena_alloc(arena, sizeof(type) * (count)))
+#define sp_arena_alloc_array(arena, type, count) \
+    ((type*) sp_arena_alloc_array_aligned(arena, sizeof(type), (count), SP_ARENA_ALIGNOF(type)))
+
+/** 
+ * Slab allocator for objects of `type`.
+ * Usage:
+ *       sp_arena_slab connections = sp_arena_pool_of(arena, connection);
+ *       connection *conn = sp_arena_slab_new(&connections, connection);
+ *       sp_arena_slab_free(&connections, conn);
+ */
+#define sp_arena_pool_of(arena, type) sp_arena_slab_create((arena), sizeof(type), SP_ARENA_ALIGNOF(type))
+
+#define sp_arena_slab_new(slab, type) ((type*) sp_arena_slab_alloc(slab))
+
+/** 
+ * Growable array of `type` backed by an arena.
+ * Usage:
+ *       sp_arena_vec(int) tokens;
+ *       sp_arena_vec_init(&tokens, arena);
+ *       sp_arena_vec_push(&tokens, 42);    // false if the arena ran out of memory
+ */
+#define sp_arena_vec(type) struct { sp_arena *arena; type *data; size_t len; size_t cap; }
+
+#define sp_arena_vec_init(vec, arena_) \
+    ((vec)->arena = (arena_), (vec)->data = NULL, (vec)->len = 0, (vec)->cap = 0)
+
+/* Make room for n elements, evaluates to false on failure */
+#define sp_arena_vec_reserve(vec, n) \
+    ((vec)->cap >= (n) || \
+     ((vec)->data = SP_ARENA_CAST_AS((vec)->data, \
+          sp_arena_vec_grow((vec)->arena, (vec)->data, &(vec)->cap, (n), sizeof(*(vec)->data))), \
+      (vec)->cap >= (n)))
+
+#define sp_arena_vec_push(vec, value) \
+    (sp_arena_vec_reserve((vec), (vec)->len + 1) ? ((vec)->data[(vec)->len++] = (value), true) : false)
+
+#define sp_arena_vec_pop(vec) ((vec)->data[--(vec)->len])
+
+#define sp_arena_vec_clear(vec) ((vec)->len = 0)
+
+#define SP_ARENA_CONCAT_(a, b) a##b
+#define SP_ARENA_CONCAT(a, b) SP_ARENA_CONCAT_(a, b)
 
 /** 
  * Helper macro for creating a temporary scope of arena with auto cleanup.
+ * Scopes nest, each one rewinds only what was allocated inside it. Leaving the 
+ * body with break, return or goto skips the rewind until an enclosing scope ends.
  * Usage:
  *       sp_arena_temp_scope(arena) {
  *           // Allocations here will be automatically freed when the scope ends
+ *           sp_arena_temp_scope(arena) {
+ *               // Freed when the inner scope ends
+ *           }
  *       }
  */
 #define sp_arena_temp_scope(arena) \
-    for (sp_arena_temp __temp = sp_arena_temp_begin(arena); __temp.block != NULL; (sp_arena_temp_end(__temp), __temp.block = NULL))
+    sp_arena_temp_scope_(arena, SP_ARENA_CONCAT(sp_arena_temp_, __LINE__))
+#define sp_arena_temp_scope_(arena, temp) \
+    for (sp_arena_temp temp = sp_arena_temp_begin(arena); temp.block != NULL; (sp_arena_temp_end(temp), temp.block = NULL))
+
+#ifdef __cplusplus
+}
+#endif
+
+/*
+ * Single header mode: define SP_ARENA_IMPLEMENTATION in exactly one translation unit
+ * before including this header to compile the implementation into it. Include the header 
+ * before any system header there, or define _DEFAULT_SOURCE first.
+ */
+#ifdef SP_ARENA_IMPLEMENTATION
+#include "sp_arena.c"
+#endif
+
+/*
+ * Profiling build: the allocation calls after this point record their callsite. 
+ * sp_arena.c defines SP_ARENA_SOURCE_ so the library's own calls aren't counted twice, 
+ * sp_arena.hpp passes its callers' lines to sp_arena_profile_alloc_aligned itself.
+ */
+#if SP_ARENA_PROFILE && !defined(SP_ARENA_SOURCE_)
+#define sp_arena_alloc(arena, size) sp_arena_profile_alloc((arena), (size), __FILE__, __LINE__)
+#define sp_arena_alloc_aligned(arena, size, alignment) \
+    sp_arena_profile_alloc_aligned((arena), (size), (alignment), __FILE__, __LINE__)
+#define sp_arena_calloc(arena, size) sp_arena_profile_calloc((arena), (size), __FILE__, __LINE__)
+#endif
 
 #endif  // SP_ARENA_H_ 
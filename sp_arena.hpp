@@ -0,0 +1,240 @@
+/**
+ * @file sp_arena.hpp - C++ wrappers of the arena allocator
+ *
+ * Move-only arena handle, RAII temporary scopes, a std::pmr::memory_resource and a
+ * stateful allocator so STL containers can bump allocate from an arena. Memory is
+ * only given back by clearing, rewinding or destroying the arena, deallocate is a no-op.
+ * sp_arena.c is still compiled as C. The handle, scopes and allocator need C++11, 
+ * arena_resource needs C++17 and <memory_resource>.
+ *
+ * Usage:
+ *       sp::arena arena;
+ *       std::vector<int, sp::arena_allocator<int>> numbers{sp::arena_allocator<int>(arena)};
+ *
+ *       sp::arena_resource resource(arena);
+ *       std::pmr::unordered_map<int, int> counts(&resource);
+ */
+
+#ifndef SP_ARENA_HPP_
+#define SP_ARENA_HPP_
+
+#include "sp_arena.h"
+
+#include <cstddef>
+#include <limits>
+#include <new>
+#include <type_traits>
+
+/* std::pmr is C++17, some standard libraries ship it later than the language mode */
+#if defined(__has_include)
+#if __cplusplus >= 201703L && __has_include(<memory_resource>)
+#define SP_ARENA_HAS_PMR 1
+#endif
+#endif
+
+#ifdef SP_ARENA_HAS_PMR
+#include <memory_resource>
+#endif
+
+/* Profiling builds attribute allocations to the caller, the builtins see through default arguments */
+#if SP_ARENA_PROFILE && (defined(__GNUC__) || defined(__clang__))
+#define SP_ARENA_CALLER_FILE __builtin_FILE()
+#define SP_ARENA_CALLER_LINE __builtin_LINE()
+#else
+#define SP_ARENA_CALLER_FILE __FILE__
+#define SP_ARENA_CALLER_LINE __LINE__
+#endif
+
+namespace sp {
+
+/**
+ * Callsite a profiling build records allocations under, empty otherwise. Defaulted
+ * parameters of this type pick up the line of the caller, classes keeping one derive 
+ * from it so it takes no space outside of profiling builds.
+ */
+struct callsite {
+#if SP_ARENA_PROFILE
+    const char *file;
+    int line;
+
+    callsite(const char *file_ = SP_ARENA_CALLER_FILE, int line_ = SP_ARENA_CALLER_LINE) noexcept 
+        : file(file_), line(line_) {}
+#endif
+};
+
+/* Allocate from an arena for C++, throwing std::bad_alloc instead of returning NULL */
+inline void *arena_allocate(sp_arena *arena, std::size_t bytes, std::size_t alignment, 
+                            const callsite &site = callsite()) {
+    /* Zero sized requests still need a distinct pointer, the arena rejects them */
+#if SP_ARENA_PROFILE
+    void *ptr = sp_arena_profile_alloc_aligned(arena, bytes ? bytes : 1, alignment, site.file, site.line);
+#else
+    (void)site;
+    void *ptr = sp_arena_alloc_aligned(arena, bytes ? bytes : 1, alignment);
+#endif
+    if (!ptr) throw std::bad_alloc();
+    return ptr;
+}
+
+/**
+ * Owning handle of an arena, destroys it when it goes out of scope. Profiling builds 
+ * record alloc under its caller and make, which can't take a defaulted callsite after 
+ * its arguments, under the line that created the handle.
+ */
+class arena : private callsite {
+public:
+    explicit arena(const callsite &site = callsite()) : callsite(site), ptr_(sp_arena_create()) {
+        if (!ptr_) throw std::bad_alloc();
+    }
+
+    explicit arena(const sp_arena_config &config, const callsite &site = callsite()) 
+        : callsite(site), ptr_(sp_arena_create_with_config(config)) {
+        if (!ptr_) throw std::bad_alloc();
+    }
+
+    /* Take ownership of an arena created with the C API */
+    explicit arena(sp_arena *adopt, const callsite &site = callsite()) noexcept : callsite(site), ptr_(adopt) {}
+
+    arena(const arena &) = delete;
+    arena &operator=(const arena &) = delete;
+
+    arena(arena &&other) noexcept : callsite(other), ptr_(other.ptr_) {
+        other.ptr_ = nullptr;
+    }
+
+    arena &operator=(arena &&other) noexcept {
+        if (this != &other) {
+            sp_arena_destroy(ptr_);
+            ptr_ = other.ptr_;
+            callsite::operator=(other);
+            other.ptr_ = nullptr;
+        }
+        return *this;
+    }
+
+    ~arena() {
+        sp_arena_destroy(ptr_);
+    }
+
+    sp_arena *get() const noexcept { return ptr_; }
+    operator sp_arena *() const noexcept { return ptr_; }
+    explicit operator bool() const noexcept { return ptr_ != nullptr; }
+
+    /* Give up ownership without destroying the arena */
+    sp_arena *release() noexcept {
+        sp_arena *ptr = ptr_;
+        ptr_ = nullptr;
+        return ptr;
+    }
+
+    void *alloc(std::size_t bytes, std::size_t alignment = alignof(std::max_align_t), 
+                const callsite &site = callsite()) {
+        return arena_allocate(ptr_, bytes, alignment, site);
+    }
+
+    /* Construct a T in the arena, its destructor never runs */
+    template <typename T, typename... Args>
+    T *make(Args &&...args) {
+        return ::new (arena_allocate(ptr_, sizeof(T), alignof(T), *this)) T(static_cast<Args &&>(args)...);
+    }
+
+    void clear() noexcept { sp_arena_clear(ptr_); }
+    std::size_t used() const noexcept { return sp_arena_total_used(ptr_); }
+    std::size_t allocated() const noexcept { return sp_arena_total_allocated(ptr_); }
+
+private:
+    sp_arena *ptr_;
+};
+
+/**
+ * Temporary scope, everything allocated from the arena while it's alive is rewound
+ * when it's destroyed.
+ */
+class arena_temp {
+public:
+    explicit arena_temp(sp_arena *arena) noexcept : temp_(sp_arena_temp_begin(arena)) {}
+
+    arena_temp(const arena_temp &) = delete;
+    arena_temp &operator=(const arena_temp &) = delete;
+
+    ~arena_temp() {
+        sp_arena_temp_end(temp_);
+    }
+
+private:
+    sp_arena_temp temp_;
+};
+
+#ifdef SP_ARENA_HAS_PMR
+/**
+ * Polymorphic memory resource over an arena. Memory is reclaimed in bulk by clearing
+ * or rewinding the arena, never by deallocate. Profiling builds record its allocations 
+ * under the line that created it, the containers calling it are no useful callsite.
+ */
+class arena_resource : public std::pmr::memory_resource, private callsite {
+public:
+    explicit arena_resource(sp_arena *arena, const callsite &site = callsite()) noexcept 
+        : callsite(site), arena_(arena) {}
+
+    sp_arena *get() const noexcept { return arena_; }
+
+protected:
+    void *do_allocate(std::size_t bytes, std::size_t alignment) override {
+        return arena_allocate(arena_, bytes, alignment, *this);
+    }
+
+    void do_deallocate(void *, std::size_t, std::size_t) override {}
+
+    bool do_is_equal(const std::pmr::memory_resource &other) const noexcept override {
+        const arena_resource *resource = dynamic_cast<const arena_resource *>(&other);
+        return resource && resource->arena_ == arena_;
+    }
+
+private:
+    sp_arena *arena_;
+};
+#endif
+
+/**
+ * Stateful allocator for STL containers. Copies share the arena and compare equal
+ * when they point at the same one. Profiling builds record its allocations under the 
+ * line that created it, copies and rebinds keep that line.
+ */
+template <typename T>
+class arena_allocator : private callsite {
+public:
+    using value_type = T;
+    using propagate_on_container_copy_assignment = std::true_type;
+    using propagate_on_container_move_assignment = std::true_type;
+    using propagate_on_container_swap = std::true_type;
+    using is_always_equal = std::false_type;
+
+    explicit arena_allocator(sp_arena *arena, const callsite &site = callsite()) noexcept 
+        : callsite(site), arena_(arena) {}
+
+    template <typename U>
+    arena_allocator(const arena_allocator<U> &other) noexcept : callsite(other.site()), arena_(other.get()) {}
+
+    T *allocate(std::size_t count) {
+        if (count > std::numeric_limits<std::size_t>::max() / sizeof(T)) throw std::bad_alloc();
+        return static_cast<T *>(arena_allocate(arena_, count * sizeof(T), alignof(T), *this));
+    }
+
+    void deallocate(T *, std::size_t) noexcept {}
+
+    sp_arena *get() const noexcept { return arena_; }
+    const callsite &site() const noexcept { return *this; }
+
+    template <typename U>
+    bool operator==(const arena_allocator<U> &other) const noexcept { return arena_ == other.get(); }
+
+    template <typename U>
+    bool operator!=(const arena_allocator<U> &other) const noexcept { return arena_ != other.get(); }
+
+private:
+    sp_arena *arena_;
+};
+
+}  /* namespace sp */
+
+#endif  /* SP_ARENA_HPP_ */
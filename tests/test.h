@@ -0,0 +1,49 @@
+/**
+ * @file test.h - Minimal harness shared by the tests
+ *
+ * Every test file is its own program. A failed CHECK reports its line and returns
+ * from the test function, main returns non-zero when any check failed.
+ */
+
+#ifndef SP_ARENA_TEST_H_
+#define SP_ARENA_TEST_H_
+
+#include "../sp_arena.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+static int test_failures = 0;
+
+#define CHECK(cond) \
+    do { \
+        if (!(cond)) { \
+            fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); \
+            test_failures++; \
+            return; \
+        } \
+    } while (0)
+
+#define RUN_TEST(test) \
+    do { \
+        int failures_before = test_failures; \
+        test(); \
+        printf("  %-44s %s\n", #test, test_failures == failures_before ? "ok" : "FAILED"); \
+    } while (0)
+
+#define TEST_RESULT() (test_failures ? EXIT_FAILURE : EXIT_SUCCESS)
+
+/* Whether a pointer is aligned to a power of two */
+static inline int test_aligned(const void *ptr, size_t alignment) {
+    return ((uintptr_t)ptr & (alignment - 1)) == 0;
+}
+
+/* Blocks in an arena's chain, large and retained blocks not included */
+static inline size_t test_chain_length(const sp_arena *arena) {
+    size_t count = 0;
+    for (const sp_arena_block *block = arena->first; block; block = block->next) count++;
+    return count;
+}
+
+#endif  // SP_ARENA_TEST_H_
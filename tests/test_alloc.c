@@ -0,0 +1,341 @@
+/**
+ * @file test_alloc.c - Allocation paths, block layout and growth
+ */
+
+#include "test.h"
+
+static size_t allocator_calls = 0;
+
+static void *counting_malloc(size_t size) {
+    allocator_calls++;
+    return malloc(size);
+}
+
+typedef struct {
+    char tag;
+    double value;
+} test_node;
+
+typedef struct {
+    _Alignas(64) char line[64];
+} test_line;
+
+/* Allocations are aligned, disjoint and fail cleanly on a full fixed arena */
+static void test_basic_alloc(void) {
+    sp_arena_config config = SP_ARENA_DEFAULT_CONFIG;
+    config.block_size = 1024;
+    config.fixed_size = true;
+    sp_arena *arena = sp_arena_create_with_config(config);
+    CHECK(arena);
+
+    CHECK(sp_arena_alloc(arena, 1000));
+    CHECK(!sp_arena_alloc(arena, 100));
+    CHECK(sp_arena_get_last_error(arena) != SP_ARENA_ERR_NONE);
+    sp_arena_destroy(arena);
+
+    arena = sp_arena_create();
+    CHECK(arena);
+    for (size_t i = 0; i < 1000; i++) {
+        char *ptr = sp_arena_alloc_aligned(arena, 100 + i, 256);
+        CHECK(ptr && test_aligned(ptr, 256));
+        memset(ptr, (int)i, 100 + i);
+    }
+
+    CHECK(!sp_arena_alloc(arena, 0));
+    CHECK(!sp_arena_alloc_aligned(arena, 8, 3));
+    CHECK(sp_arena_get_last_error(arena) == SP_ARENA_ERR_INVALID_ALIGNMENT);
+    CHECK(sp_arena_create_with_config((sp_arena_config){.alignment = 3, .block_size = 4096}) == NULL);
+    sp_arena_destroy(arena);
+}
+
+/* Requests near SIZE_MAX fail in every sync mode without wrapping the bump pointer */
+static void test_no_wraparound(void) {
+    sp_arena_sync_t modes[] = { SP_ARENA_SYNC_MUTEX, SP_ARENA_SYNC_THREAD_CACHE,
+                                SP_ARENA_SYNC_ATOMIC, SP_ARENA_SYNC_NONE };
+    for (size_t m = 0; m < sizeof(modes) / sizeof(modes[0]); m++) {
+        for (int variant = 0; variant < 3; variant++) {
+            sp_arena_config config = SP_ARENA_DEFAULT_CONFIG;
+            config.sync = modes[m];
+            if (variant == 1) config.reserve_size = MB(1);
+            if (variant == 2) config.fixed_size = true;
+            sp_arena *arena = sp_arena_create_with_config(config);
+            CHECK(arena);
+
+            CHECK(sp_arena_alloc(arena, 8));
+            size_t used = sp_arena_total_used(arena);
+            for (size_t d = 1; d < 80; d += 7) {
+                CHECK(!sp_arena_alloc(arena, SIZE_MAX - d));
+                CHECK(!sp_arena_alloc_aligned(arena, SIZE_MAX - d, 64));
+            }
+            CHECK(sp_arena_total_used(arena) == used);
+            CHECK(sp_arena_alloc(arena, 8));
+            sp_arena_destroy(arena);
+        }
+    }
+}
+
+/* Typed helpers use the natural alignment and check array sizes for overflow */
+static void test_typed_alloc(void) {
+    sp_arena_config config = SP_ARENA_DEFAULT_CONFIG;
+    config.alignment = 1;
+    sp_arena *arena = sp_arena_create_with_config(config);
+    CHECK(arena);
+
+    sp_arena_alloc(arena, 1);
+    test_node *node = sp_arena_alloc_type(arena, test_node);
+    CHECK(node && test_aligned(node, SP_ARENA_ALIGNOF(test_node)));
+    test_line *lines = sp_arena_alloc_array(arena, test_line, 4);
+    CHECK(lines && test_aligned(lines, 64));
+    memset(lines, 0, 4 * sizeof(test_line));
+
+    CHECK(!sp_arena_alloc_array(arena, test_line, SIZE_MAX / 8));
+    CHECK(sp_arena_get_last_error(arena) == SP_ARENA_ERR_ALLOCATION_TOO_LARGE);
+    sp_arena_destroy(arena);
+}
+
+/* Each block is one allocation, its memory starts right after the header */
+static void test_block_layout(void) {
+    sp_arena_config config = SP_ARENA_DEFAULT_CONFIG;
+    config.block_size = KB(4);
+    config.allocator = counting_malloc;
+    config.deallocator = free;
+    allocator_calls = 0;
+    sp_arena *arena = sp_arena_create_with_config(config);
+    CHECK(arena);
+    CHECK(allocator_calls == 1);
+
+    char *ptr = sp_arena_alloc(arena, 16);
+    CHECK(ptr == sp_arena_block_memory(arena->first));
+    CHECK(sp_arena_block_memory(arena->first) == (char *)arena->first + SP_ARENA_BLOCK_HEADER_SIZE);
+
+    for (int i = 0; i < 3; i++) CHECK(sp_arena_alloc(arena, KB(3)));
+    CHECK(allocator_calls == test_chain_length(arena));
+    sp_arena_destroy(arena);
+}
+
+/* Blocks grow geometrically up to max_block_size and leave room for repeated requests */
+static void test_block_growth(void) {
+    sp_arena_config config = SP_ARENA_DEFAULT_CONFIG;
+    config.block_size = KB(4);
+    config.growth_factor = 2.0;
+    config.max_block_size = KB(64);
+    sp_arena *arena = sp_arena_create_with_config(config);
+    CHECK(arena);
+
+    for (int i = 0; i < 2000; i++) CHECK(sp_arena_alloc(arena, 200));
+    size_t previous = 0;
+    for (sp_arena_block *block = arena->first; block; block = block->next) {
+        size_t bytes = block->size + SP_ARENA_BLOCK_HEADER_SIZE;
+        CHECK(bytes <= KB(64));
+        CHECK(bytes >= previous);
+        previous = bytes;
+    }
+    CHECK(previous == KB(64));
+    CHECK(test_chain_length(arena) < 20);
+    sp_arena_destroy(arena);
+
+    config = SP_ARENA_DEFAULT_CONFIG;
+    config.block_size = KB(4);
+    config.request_multiple = 8;
+    arena = sp_arena_create_with_config(config);
+    CHECK(arena);
+    for (int i = 0; i < 8; i++) CHECK(sp_arena_alloc(arena, KB(3)));
+    CHECK(test_chain_length(arena) == 2);
+    sp_arena_destroy(arena);
+}
+
+/* Large requests get their own block and don't retire the current one */
+static void test_large_alloc(void) {
+    sp_arena *arena = sp_arena_create();
+    CHECK(arena);
+
+    char *small = sp_arena_alloc(arena, 100);
+    size_t allocated = sp_arena_total_allocated(arena);
+    char *large = sp_arena_alloc(arena, MB(1));
+    CHECK(large && arena->large);
+    memset(large, 1, MB(1));
+    char *next = sp_arena_alloc(arena, 100);
+    CHECK(arena->first == arena->current && !arena->first->next);
+    CHECK(next > small && next < small + 200);
+
+    sp_arena_temp temp = sp_arena_temp_begin(arena);
+    char *inner = sp_arena_alloc(arena, MB(2));
+    CHECK(inner);
+    memset(inner, 2, MB(2));
+    char *grown = sp_arena_resize(arena, inner, MB(2), MB(3));
+    CHECK(grown && grown[MB(2) - 1] == 2);
+    sp_arena_temp_end(temp);
+    CHECK(large[MB(1) - 1] == 1);
+
+    sp_arena_clear(arena);
+    CHECK(arena->large == NULL);
+    CHECK(sp_arena_total_allocated(arena) == allocated);
+    sp_arena_destroy(arena);
+}
+
+/* Batches and struct of arrays are carved out of one allocation */
+static void test_batch_alloc(void) {
+    sp_arena *arena = sp_arena_create();
+    CHECK(arena);
+
+    size_t sizes[4] = { 24, 3, 0, 640 };
+    size_t aligns[4] = { 8, 1, 16, 64 };
+    void *out[4];
+    char *base = sp_arena_alloc_batch(arena, sizes, aligns, out, 4);
+    CHECK(base && base == out[0]);
+    for (int i = 0; i < 4; i++) CHECK(test_aligned(out[i], aligns[i]));
+    CHECK((char *)out[1] >= (char *)out[0] + 24 && (char *)out[3] >= (char *)out[1] + 3);
+    memset(out[3], 1, 640);
+
+    size_t elem_sizes[3] = { sizeof(float), sizeof(double), 1 };
+    void *arrays[3];
+    CHECK(sp_arena_alloc_soa(arena, 10000, elem_sizes, NULL, arrays, 3));
+    CHECK(test_aligned(arrays[1], SP_ARENA_ALIGNOF(double)));
+    memset(arrays[0], 0, 10000 * sizeof(float));
+    memset(arrays[1], 0, 10000 * sizeof(double));
+    memset(arrays[2], 0, 10000);
+
+    size_t bad[1] = { 3 };
+    CHECK(!sp_arena_alloc_batch(arena, sizes, bad, out, 1));
+    CHECK(sp_arena_get_last_error(arena) == SP_ARENA_ERR_INVALID_ALIGNMENT);
+    size_t huge[1] = { SIZE_MAX / 2 };
+    CHECK(!sp_arena_alloc_soa(arena, 4, huge, NULL, out, 1));
+    CHECK(sp_arena_get_last_error(arena) == SP_ARENA_ERR_ALLOCATION_TOO_LARGE);
+    sp_arena_destroy(arena);
+}
+
+static int all_zero(const unsigned char *ptr, size_t size) {
+    for (size_t i = 0; i < size; i++) {
+        if (ptr[i] != 0) return 0;
+    }
+    return 1;
+}
+
+/* calloc returns zeroed memory whether or not it skips the memset */
+static void test_calloc_dirty(void) {
+    sp_arena_config configs[3] = { SP_ARENA_DEFAULT_CONFIG, SP_ARENA_DEFAULT_CONFIG, SP_ARENA_DEFAULT_CONFIG };
+    configs[0].block_size = KB(16);
+    configs[1].reserve_size = MB(16);
+    configs[1].decommit_on_clear = true;
+    configs[2].block_size = KB(16);
+    configs[2].retain_large = true;
+
+    for (int c = 0; c < 3; c++) {
+        sp_arena *arena = sp_arena_create_with_config(configs[c]);
+        CHECK(arena);
+        for (int round = 0; round < 4; round++) {
+            sp_arena_temp temp = sp_arena_temp_begin(arena);
+            for (int i = 0; i < 20; i++) {
+                unsigned char *ptr = sp_arena_calloc(arena, 1000 + (size_t)i * 37);
+                CHECK(ptr && all_zero(ptr, 1000 + (size_t)i * 37));
+                memset(ptr, 0xAB, 1000 + (size_t)i * 37);
+            }
+            unsigned char *large = sp_arena_calloc(arena, MB(1));
+            CHECK(large && all_zero(large, MB(1)));
+            memset(large, 0xCD, MB(1));
+
+            // A shrunk allocation leaves dirty bytes past its new end
+            char *shrunk = sp_arena_alloc(arena, 100);
+            memset(shrunk, 0xEF, 100);
+            CHECK(sp_arena_resize(arena, shrunk, 100, 10));
+            unsigned char *after = sp_arena_calloc(arena, 500);
+            CHECK(after && all_zero(after, 500));
+            memset(after, 0x12, 500);
+
+            if (round & 1) sp_arena_temp_end(temp);
+            else sp_arena_clear(arena);
+        }
+        sp_arena_destroy(arena);
+    }
+}
+
+/* Isolated allocations start on their own cache line, hot fields don't share one */
+static void test_isolated_alloc(void) {
+    sp_arena *arena = sp_arena_create();
+    CHECK(arena && test_aligned(arena, SP_ARENA_CACHE_LINE_SIZE));
+
+    sp_arena_alloc(arena, 3);
+    char *isolated = sp_arena_alloc_isolated(arena, 10);
+    char *after = sp_arena_alloc(arena, 1);
+    CHECK(test_aligned(isolated, SP_ARENA_CACHE_LINE_SIZE) && after >= isolated + SP_ARENA_CACHE_LINE_SIZE);
+    sp_arena_destroy(arena);
+
+    sp_arena_config config = SP_ARENA_DEFAULT_CONFIG;
+    config.isolate = true;
+    arena = sp_arena_create_with_config(config);
+    CHECK(arena);
+    for (int i = 0; i < 100; i++) {
+        CHECK(test_aligned(sp_arena_alloc_type(arena, char), SP_ARENA_CACHE_LINE_SIZE));
+        CHECK(test_aligned(sp_arena_strdup(arena, "x"), SP_ARENA_CACHE_LINE_SIZE));
+    }
+    sp_arena_destroy(arena);
+}
+
+/* The last allocation resizes in place, others move with their contents */
+static void test_resize(void) {
+    sp_arena *arena = sp_arena_create();
+    CHECK(arena);
+
+    char *last = sp_arena_alloc(arena, 10);
+    memcpy(last, "resizable", 10);
+#if !SP_ARENA_DEBUG
+    // Debug builds keep a redzone after the last allocation, so it always moves
+    CHECK(sp_arena_resize(arena, last, 10, 100) == last);
+    CHECK(sp_arena_resize(arena, last, 100, 20) == last);
+#else
+    last = sp_arena_resize(arena, last, 10, 20);
+    CHECK(last && strcmp(last, "resizable") == 0);
+#endif
+
+    sp_arena_alloc(arena, 8);
+    char *moved = sp_arena_resize(arena, last, 20, 40);
+    CHECK(moved && moved != last && strcmp(moved, "resizable") == 0);
+
+    CHECK(!sp_arena_resize(arena, moved, 40, 0));
+    CHECK(sp_arena_get_last_error(arena) == SP_ARENA_ERR_INVALID_SIZE);
+
+    // The _unlocked calls run under the caller's lock
+    sp_arena_lock(arena);
+    char *buf = sp_arena_alloc_unlocked(arena, 16);
+    memset(buf, 1, 16);
+    for (int i = 0; i < 20; i++) {
+        buf = sp_arena_resize_unlocked(arena, buf, 16 + (size_t)i * 8, 24 + (size_t)i * 8);
+        CHECK(buf && buf[0] == 1);
+        memset(buf, 1, 24 + (size_t)i * 8);
+    }
+    CHECK(test_aligned(sp_arena_alloc_aligned_unlocked(arena, 100, 128), 128));
+    sp_arena_unlock(arena);
+    sp_arena_destroy(arena);
+}
+
+/* Builds without thread safety report the sync mode they actually run in */
+static void test_sync_config(void) {
+    sp_arena_config config = SP_ARENA_DEFAULT_CONFIG;
+    config.sync = SP_ARENA_SYNC_ATOMIC;
+    sp_arena *arena = sp_arena_create_with_config(config);
+    CHECK(arena);
+#if !SP_ARENA_THREAD_SAFE
+    CHECK(arena->config.sync == SP_ARENA_SYNC_NONE);
+#elif SP_ARENA_DEBUG
+    CHECK(arena->config.sync == SP_ARENA_SYNC_MUTEX);
+#else
+    CHECK(arena->config.sync == SP_ARENA_SYNC_ATOMIC);
+#endif
+    CHECK(sp_arena_alloc(arena, 8));
+    sp_arena_destroy(arena);
+}
+
+int main(void) {
+    RUN_TEST(test_basic_alloc);
+    RUN_TEST(test_no_wraparound);
+    RUN_TEST(test_typed_alloc);
+    RUN_TEST(test_block_layout);
+    RUN_TEST(test_block_growth);
+    RUN_TEST(test_large_alloc);
+    RUN_TEST(test_batch_alloc);
+    RUN_TEST(test_calloc_dirty);
+    RUN_TEST(test_isolated_alloc);
+    RUN_TEST(test_resize);
+    RUN_TEST(test_sync_config);
+    return TEST_RESULT();
+}
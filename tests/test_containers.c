@@ -0,0 +1,225 @@
+/**
+ * @file test_containers.c - Vectors, string builders, slabs and hash maps in an arena
+ */
+
+#include "test.h"
+
+typedef struct {
+    double x;
+    char c;
+} test_point;
+
+typedef struct {
+    _Alignas(32) char v[32];
+} test_wide;
+
+typedef struct {
+    int fd;
+    char buf[100];
+    double d;
+} test_conn;
+
+/* Vectors keep their element alignment and contents as they grow */
+static void test_vec(void) {
+    sp_arena *arena = sp_arena_create();
+    CHECK(arena);
+
+    sp_arena_vec(int) ints;
+    sp_arena_vec_init(&ints, arena);
+    for (int i = 0; i < 10000; i++) CHECK(sp_arena_vec_push(&ints, i));
+    CHECK(ints.len == 10000 && ints.cap >= 10000);
+    for (int i = 0; i < 10000; i++) CHECK(ints.data[i] == i);
+    CHECK(sp_arena_vec_pop(&ints) == 9999);
+
+    sp_arena_vec(test_point) points;
+    sp_arena_vec(test_wide) wide;
+    sp_arena_vec_init(&points, arena);
+    sp_arena_vec_init(&wide, arena);
+    CHECK(sp_arena_vec_reserve(&wide, 10));
+    for (int i = 0; i < 1000; i++) {
+        test_point point = { i, 'a' };
+        test_wide element = {{ 0 }};
+        element.v[0] = (char)i;
+        CHECK(sp_arena_vec_push(&points, point));
+        CHECK(sp_arena_vec_push(&wide, element));
+        CHECK(test_aligned(wide.data, 32));
+    }
+    for (int i = 0; i < 1000; i++) CHECK(points.data[i].x == i && wide.data[i].v[0] == (char)i);
+
+    sp_arena_vec_clear(&ints);
+    CHECK(ints.len == 0 && ints.data);
+    sp_arena_destroy(arena);
+}
+
+/* String builders stay NUL terminated through appends and formatted appends */
+static void test_sb(void) {
+    sp_arena *arena = sp_arena_create();
+    CHECK(arena);
+
+    sp_arena_sb sb;
+    sp_arena_sb_init(&sb, arena);
+    CHECK(strcmp(sp_arena_sb_cstr(&sb), "") == 0);
+    for (int i = 0; i < 5000; i++) CHECK(sp_arena_sb_appendf(&sb, "%d,", i));
+    CHECK(sp_arena_sb_append(&sb, "end", 3));
+    const char *str = sp_arena_sb_cstr(&sb);
+    CHECK(strncmp(str, "0,1,2,", 6) == 0);
+    CHECK(strlen(str) == sb.len && strcmp(str + sb.len - 3, "end") == 0);
+    sp_arena_destroy(arena);
+}
+
+/* Freed objects are reused and never outlive the arena memory they came from */
+static void test_slab(void) {
+    sp_arena *arena = sp_arena_create();
+    CHECK(arena);
+
+    sp_arena_slab slab = sp_arena_pool_of(arena, test_conn);
+    test_conn *conns[1000];
+    for (int round = 0; round < 3; round++) {
+        for (int i = 0; i < 1000; i++) {
+            conns[i] = sp_arena_slab_new(&slab, test_conn);
+            CHECK(conns[i] && test_aligned(conns[i], SP_ARENA_ALIGNOF(test_conn)));
+            memset(conns[i], i, sizeof(test_conn));
+        }
+        size_t used = sp_arena_total_used(arena);
+        for (int i = 0; i < 1000; i++) sp_arena_slab_free(&slab, conns[i]);
+        for (int i = 0; i < 1000; i++) CHECK(sp_arena_slab_new(&slab, test_conn));
+        CHECK(sp_arena_total_used(arena) == used);
+        sp_arena_clear(arena);
+    }
+
+    // Objects freed before a clear are dropped rather than handed out again
+    sp_arena_slab_free(&slab, conns[0]);
+    CHECK(sp_arena_total_used(arena) == 0);
+    CHECK(sp_arena_slab_new(&slab, test_conn) && sp_arena_total_used(arena) > 0);
+    sp_arena_destroy(arena);
+}
+
+/* Only rewinds below a slab's memory drop it, unrelated scopes leave it in use */
+static void test_slab_scopes(void) {
+    sp_arena_config config = SP_ARENA_DEFAULT_CONFIG;
+    config.block_size = KB(64);
+    sp_arena *arena = sp_arena_create_with_config(config);
+    CHECK(arena);
+
+    sp_arena_slab slab = sp_arena_slab_create(arena, SP_ARENA_SLAB_SIZE / 16, 8);
+    void *objects[16];
+    size_t used = 0;
+    for (int round = 0; round < 1000; round++) {
+        for (int i = 0; i < 16; i++) objects[i] = sp_arena_slab_alloc(&slab);
+        sp_arena_temp_scope(arena) {
+            sp_arena_alloc(arena, 100);
+        }
+        for (int i = 0; i < 16; i++) sp_arena_slab_free(&slab, objects[i]);
+        if (round == 0) used = sp_arena_total_used(arena);
+    }
+    CHECK(sp_arena_total_used(arena) == used);
+
+    // A slab taken inside a scope lives until that scope ends
+    sp_arena_temp temp = sp_arena_temp_begin(arena);
+    sp_arena_slab inner = sp_arena_slab_create(arena, 32, 8);
+    void *ptr = sp_arena_slab_alloc(&inner);
+    sp_arena_temp_scope(arena) {
+        sp_arena_alloc(arena, 10);
+    }
+    sp_arena_slab_free(&inner, ptr);
+    CHECK(sp_arena_slab_alloc(&inner) == ptr);
+    sp_arena_slab_free(&inner, ptr);
+    sp_arena_temp_end(temp);
+    sp_arena_slab_free(&inner, ptr);
+    size_t before = sp_arena_total_used(arena);
+    void *fresh = sp_arena_slab_alloc(&inner);
+    CHECK(fresh && sp_arena_total_used(arena) > before);
+    memset(fresh, 1, 32);
+    sp_arena_destroy(arena);
+}
+
+/* Size classes round requests up and send the largest ones to the arena */
+static void test_slab_classes(void) {
+    sp_arena *arena = sp_arena_create();
+    CHECK(arena);
+
+    sp_arena_slab_classes classes;
+    sp_arena_slab_classes_init(&classes, arena);
+    for (size_t size = 1; size < 400; size++) {
+        char *ptr = sp_arena_slab_classes_alloc(&classes, size);
+        CHECK(ptr);
+        memset(ptr, 1, size);
+        sp_arena_slab_classes_free(&classes, ptr, size);
+        char *again = sp_arena_slab_classes_alloc(&classes, size);
+        CHECK(size > 256 || again == ptr);
+    }
+
+    // The class slab predates the scope, so its objects outlive it
+    sp_arena_temp_scope(arena) {
+        void *scoped = sp_arena_slab_classes_alloc(&classes, 10);
+        sp_arena_temp_end(sp_arena_temp_begin(arena));
+        sp_arena_slab_classes_free(&classes, scoped, 10);
+        CHECK(sp_arena_slab_classes_alloc(&classes, 10) == scoped);
+    }
+    void *kept = sp_arena_slab_classes_alloc(&classes, 10);
+    sp_arena_slab_classes_free(&classes, kept, 10);
+    CHECK(sp_arena_slab_classes_alloc(&classes, 10) == kept);
+    sp_arena_destroy(arena);
+}
+
+/* Keys are found after growth, interned strings are shared and rewinds forget newer keys */
+static void test_map(void) {
+    sp_arena *arena = sp_arena_create();
+    CHECK(arena);
+
+    sp_arena_map map;
+    sp_arena_map_init(&map, arena);
+    char key[64];
+    CHECK(!sp_arena_map_find(&map, "x", 1));
+    for (intptr_t i = 0; i < 100000; i++) {
+        int len = snprintf(key, sizeof(key), "key-%ld", (long)i);
+        CHECK(sp_arena_map_put(&map, key, (size_t)len, (void *)i));
+    }
+    CHECK(map.count == 100000);
+    for (intptr_t i = 0; i < 100000; i++) {
+        int len = snprintf(key, sizeof(key), "key-%ld", (long)i);
+        sp_arena_map_entry *entry = sp_arena_map_find(&map, key, (size_t)len);
+        CHECK(entry && (intptr_t)entry->value == i && strcmp(entry->key, key) == 0);
+    }
+    CHECK(!sp_arena_map_find(&map, "nope", 4));
+    CHECK(sp_arena_map_put(&map, "key-7", 5, NULL) && map.count == 100000);
+    CHECK(sp_arena_map_find(&map, "key-7", 5)->value == NULL);
+
+    const char *hello = sp_arena_intern(&map, "hello", 5);
+    CHECK(hello && hello == sp_arena_intern(&map, "hello", 5) && strcmp(hello, "hello") == 0);
+    CHECK(sp_arena_intern(&map, "", 0)[0] == '\0');
+
+    // Reserved room keeps the entries in place while a scope adds keys
+    CHECK(sp_arena_map_reserve(&map, map.count + 5000));
+    size_t mark = map.count;
+    sp_arena_map_entry *entries = map.entries;
+    sp_arena_temp_scope(arena) {
+        for (intptr_t i = 0; i < 5000; i++) {
+            int len = snprintf(key, sizeof(key), "tmp-%ld", (long)i);
+            CHECK(sp_arena_map_put(&map, key, (size_t)len, (void *)i));
+        }
+        CHECK(map.entries == entries);
+        sp_arena_map_rewind(&map, mark);
+    }
+    CHECK(map.count == mark);
+    for (intptr_t i = 0; i < 5000; i++) {
+        int len = snprintf(key, sizeof(key), "tmp-%ld", (long)i);
+        CHECK(!sp_arena_map_find(&map, key, (size_t)len));
+    }
+    for (intptr_t i = 0; i < 100000; i += 7) {
+        int len = snprintf(key, sizeof(key), "key-%ld", (long)i);
+        CHECK(sp_arena_map_find(&map, key, (size_t)len));
+    }
+    CHECK(sp_arena_map_put(&map, "after", 5, NULL) && sp_arena_map_find(&map, "after", 5));
+    sp_arena_destroy(arena);
+}
+
+int main(void) {
+    RUN_TEST(test_vec);
+    RUN_TEST(test_sb);
+    RUN_TEST(test_slab);
+    RUN_TEST(test_slab_scopes);
+    RUN_TEST(test_slab_classes);
+    RUN_TEST(test_map);
+    return TEST_RESULT();
+}
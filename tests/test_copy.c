@@ -0,0 +1,110 @@
+/**
+ * @file test_copy.c - String and memory copies and what clears do to old contents
+ */
+
+#include "test.h"
+
+/* Copies match their sources, large ones start on a cache line */
+static void test_dup(void) {
+    sp_arena *arena = sp_arena_create();
+    CHECK(arena);
+
+    for (int i = 0; i < 2000; i++) {
+        char buf[32];
+        snprintf(buf, sizeof(buf), "str%d", i);
+        char *copy = sp_arena_strdup(arena, buf);
+        CHECK(copy && strcmp(copy, buf) == 0);
+    }
+
+    static char big[200000];
+    memset(big, 'x', sizeof(big) - 1);
+    char *big_copy = sp_arena_strdup(arena, big);
+    CHECK(big_copy && strcmp(big_copy, big) == 0);
+    CHECK(strcmp(sp_arena_strndup(arena, "hello world", 5), "hello") == 0);
+    CHECK(strcmp(sp_arena_strndup(arena, "hi", 50), "hi") == 0);
+
+    size_t size = MB(3) + 13;
+    char *src = malloc(size);
+    CHECK(src);
+    for (size_t i = 0; i < size; i++) src[i] = (char)(i * 7);
+    char *streamed = sp_arena_memdup(arena, src, size);
+    CHECK(streamed && test_aligned(streamed, SP_ARENA_CACHE_LINE_SIZE) && memcmp(streamed, src, size) == 0);
+    char *small = sp_arena_memdup(arena, src + 1, 100);
+    CHECK(small && memcmp(small, src + 1, 100) == 0);
+    free(src);
+
+    CHECK(!sp_arena_strdup(arena, NULL));
+    CHECK(!sp_arena_memdup(arena, NULL, 10));
+    sp_arena_destroy(arena);
+}
+
+#if !SP_ARENA_DEBUG
+static int has_marker(const sp_arena_block *block) {
+    const char *memory = sp_arena_block_memory(block);
+    for (size_t i = 0; i < block->size; i++) {
+        if (memory[i] == 'Q') return 1;
+    }
+    return 0;
+}
+
+/* Blocks start out zeroed, so markers malloc hands back from earlier arenas don't count */
+static void *zeroing_malloc(size_t size) {
+    return calloc(1, size);
+}
+
+static int chain_has_marker(const sp_arena_block *block) {
+    for (; block; block = block->next) {
+        if (has_marker(block)) return 1;
+    }
+    return 0;
+}
+#endif
+
+/* Zero and poison clear modes scrub every block that was in use, retained ones included */
+static void test_clear_modes(void) {
+    for (int mode = SP_ARENA_CLEAR_NONE; mode <= SP_ARENA_CLEAR_POISON; mode++) {
+        sp_arena_config config = SP_ARENA_DEFAULT_CONFIG;
+        config.block_size = KB(4);
+        config.clear_mode = (sp_arena_clear_mode_t)mode;
+        config.retain_large = true;
+#if !SP_ARENA_DEBUG
+        config.allocator = zeroing_malloc;
+        config.deallocator = free;
+#endif
+        sp_arena *arena = sp_arena_create_with_config(config);
+        CHECK(arena);
+
+        char *keep = sp_arena_alloc(arena, 100);
+        memset(keep, 'Q', 100);
+        sp_arena_temp temp = sp_arena_temp_begin(arena);
+        for (int i = 0; i < 10; i++) memset(sp_arena_alloc(arena, 1500), 'Q', 1500);
+        memset(sp_arena_alloc(arena, 20000), 'Q', 20000);
+        sp_arena_temp_end(temp);
+        sp_arena_clear(arena);
+
+        // Debug builds poison cleared memory for ASan, so it can't be read back
+#if !SP_ARENA_DEBUG
+        if (mode == SP_ARENA_CLEAR_ZERO) CHECK(keep[0] == 0);
+        if (mode == SP_ARENA_CLEAR_POISON) CHECK((unsigned char)keep[0] == SP_ARENA_POISON_BYTE);
+        if (mode != SP_ARENA_CLEAR_NONE) {
+            CHECK(!chain_has_marker(arena->first));
+            CHECK(!chain_has_marker(arena->pending));
+            for (int i = 0; i < SP_ARENA_FREE_BINS; i++) CHECK(!chain_has_marker(arena->free_bins[i]));
+        }
+#endif
+
+        // Poisoned memory is still zeroed by calloc
+        for (int i = 0; i < 50; i++) {
+            unsigned char *zeroed = sp_arena_calloc(arena, 10000);
+            CHECK(zeroed);
+            for (int j = 0; j < 10000; j++) CHECK(zeroed[j] == 0);
+        }
+        sp_arena_destroy(arena);
+    }
+}
+
+int main(void) {
+    RUN_TEST(test_dup);
+    RUN_TEST(test_clear_modes);
+    return TEST_RESULT();
+}
@@ -0,0 +1,107 @@
+/**
+ * @file test_cpp.cpp - The C++ wrappers of sp_arena.hpp
+ */
+
+#include "test.h"
+#include "../sp_arena.hpp"
+#include <vector>
+#include <string>
+#include <unordered_map>
+
+struct test_pair {
+    int a;
+    double b;
+    test_pair(int a_, double b_) : a(a_), b(b_) {}
+};
+
+/* Standard containers allocate from the arena through arena_allocator */
+static void test_allocator(void) {
+    sp::arena arena;
+    CHECK(arena);
+
+    std::vector<int, sp::arena_allocator<int>> values{sp::arena_allocator<int>(arena)};
+    for (int i = 0; i < 10000; i++) values.push_back(i);
+    CHECK(values[9999] == 9999);
+
+    using pair_allocator = sp::arena_allocator<std::pair<const int, int>>;
+    std::unordered_map<int, int, std::hash<int>, std::equal_to<int>, pair_allocator> map{
+        10, std::hash<int>(), std::equal_to<int>(), pair_allocator(arena)};
+    for (int i = 0; i < 1000; i++) map[i] = i * 2;
+    CHECK(map[500] == 1000);
+    CHECK(arena.used() > 10000 * sizeof(int));
+}
+
+/* Scopes rewind what pmr containers took through arena_resource */
+static void test_scope_resource(void) {
+    sp::arena arena;
+    CHECK(arena);
+    arena.alloc(100);
+    size_t before = arena.used();
+    {
+        sp::arena_temp scope(arena);
+#ifdef SP_ARENA_HAS_PMR
+        sp::arena_resource resource(arena);
+        std::pmr::vector<std::pmr::string> strings(&resource);
+        for (int i = 0; i < 100; i++) {
+            strings.emplace_back("a string too long for the small string buffer " + std::to_string(i));
+        }
+        CHECK(strings[42].find("42") != std::string::npos);
+        sp::arena_resource other(arena);
+        CHECK(resource == other);
+#else
+        arena.alloc(1000);
+#endif
+    }
+    CHECK(arena.used() == before);
+}
+
+/* make constructs in place, moves transfer ownership and failures throw */
+static void test_make_move(void) {
+    sp::arena arena;
+    test_pair *pair = arena.make<test_pair>(1, 2.0);
+    CHECK(pair && pair->a == 1 && pair->b == 2.0);
+
+    sp::arena moved = std::move(arena);
+    CHECK(!arena && moved);
+    moved.clear();
+    CHECK(moved.used() == 0);
+
+    sp_arena_config config = SP_ARENA_DEFAULT_CONFIG;
+    config.fixed_size = true;
+    config.block_size = KB(4);
+    sp::arena small(config);
+    bool threw = false;
+    try {
+        small.alloc(KB(8));
+    } catch (const std::bad_alloc &) {
+        threw = true;
+    }
+    CHECK(threw);
+}
+
+#if SP_ARENA_PROFILE && defined(__GNUC__)
+/* Wrapper allocations are recorded under the caller, not under sp_arena.hpp */
+static void test_profile_callsites(void) {
+    sp_arena_profile_reset();
+    sp::arena arena;
+    arena.alloc(100);
+    std::vector<int, sp::arena_allocator<int>> values{sp::arena_allocator<int>(arena)};
+    for (int i = 0; i < 100; i++) values.push_back(i);
+    arena.make<int>(5);
+
+    sp_arena_callsite sites[16];
+    size_t count = sp_arena_profile_callsites(sites, ArrayLen(sites));
+    CHECK(count == 3);
+    for (size_t i = 0; i < count; i++) CHECK(strstr(sites[i].file, "test_cpp.cpp") != NULL);
+}
+#endif
+
+int main(void) {
+    RUN_TEST(test_allocator);
+    RUN_TEST(test_scope_resource);
+    RUN_TEST(test_make_move);
+#if SP_ARENA_PROFILE && defined(__GNUC__)
+    RUN_TEST(test_profile_callsites);
+#endif
+    return TEST_RESULT();
+}
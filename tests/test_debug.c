@@ -0,0 +1,164 @@
+/**
+ * @file test_debug.c - Guard pages and the ASan poisoning of debug builds
+ *
+ * Faults are provoked in forked children, a check passes when the child dies.
+ */
+
+#define _DEFAULT_SOURCE
+#include "test.h"
+#include <unistd.h>
+#include <sys/wait.h>
+
+#if defined(__SANITIZE_ADDRESS__)
+#define TEST_ASAN 1
+#elif defined(__has_feature)
+#if __has_feature(address_sanitizer)
+#define TEST_ASAN 1
+#endif
+#endif
+
+/* Run a function in a forked child, true when the child was killed or exited with an error */
+static int child_dies(void (*fault)(sp_arena *), sp_arena *arena) {
+    fflush(stdout);
+    fflush(stderr);
+    pid_t pid = fork();
+    if (pid < 0) return 0;
+    if (pid == 0) {
+        // Keep the expected ASan report out of the test output
+        freopen("/dev/null", "w", stderr);
+        fault(arena);
+        _exit(0);
+    }
+    int status = 0;
+    waitpid(pid, &status, 0);
+    return !WIFEXITED(status) || WEXITSTATUS(status) != 0;
+}
+
+static void write_past_block(sp_arena *arena) {
+    sp_arena_block *block = arena->current;
+    volatile char *end = sp_arena_block_memory(block) + block->size;
+    end[0] = 1;
+}
+
+/* A guard page after each block faults writes that run off its end */
+static void test_guard_pages(void) {
+    sp_arena_config config = SP_ARENA_DEFAULT_CONFIG;
+    config.guard_pages = true;
+    config.block_size = KB(8);
+    sp_arena *arena = sp_arena_create_with_config(config);
+    CHECK(arena);
+
+    for (int i = 0; i < 100; i++) {
+        char *ptr = sp_arena_alloc(arena, 1000);
+        CHECK(ptr);
+        memset(ptr, 1, 1000);
+    }
+    CHECK(child_dies(write_past_block, arena));
+    sp_arena_clear(arena);
+    CHECK(sp_arena_alloc(arena, 1000));
+    sp_arena_destroy(arena);
+}
+
+/* Regular use, resizes and containers included, stays clear of the poisoned memory */
+static void test_clean_use(void) {
+    sp_arena_config config = SP_ARENA_DEFAULT_CONFIG;
+    config.block_size = KB(4);
+    sp_arena *arena = sp_arena_create_with_config(config);
+    CHECK(arena);
+
+    for (int round = 0; round < 3; round++) {
+        sp_arena_temp temp = sp_arena_temp_begin(arena);
+        for (int i = 0; i < 500; i++) memset(sp_arena_alloc(arena, 13), 1, 13);
+        CHECK(strcmp(sp_arena_strdup(arena, "hello"), "hello") == 0);
+        int *values = sp_arena_alloc(arena, 16);
+        for (int k = 1; k < 100; k++) {
+            values = sp_arena_resize(arena, values, 16 * (size_t)k, 16 * (size_t)(k + 1));
+            CHECK(values);
+            values[4 * k] = k;
+        }
+        memset(sp_arena_calloc(arena, KB(64)), 3, KB(64));
+        sp_arena_temp_end(temp);
+    }
+
+    sp_arena_sb sb;
+    sp_arena_sb_init(&sb, arena);
+    for (int i = 0; i < 100; i++) CHECK(sp_arena_sb_appendf(&sb, "%d,", i));
+    sp_arena_map map;
+    sp_arena_map_init(&map, arena);
+    for (intptr_t i = 0; i < 100; i++) {
+        char key[8];
+        int len = snprintf(key, sizeof(key), "%d", (int)i);
+        CHECK(sp_arena_map_put(&map, key, (size_t)len, (void *)i));
+    }
+    sp_arena_destroy(arena);
+}
+
+#if SP_ARENA_DEBUG && defined(TEST_ASAN)
+static void write_redzone(sp_arena *arena) {
+    volatile char *ptr = sp_arena_alloc(arena, 32);
+    ptr[32] = 1;
+}
+
+static void write_rewound(sp_arena *arena) {
+    sp_arena_temp temp = sp_arena_temp_begin(arena);
+    volatile char *ptr = sp_arena_alloc(arena, 32);
+    sp_arena_temp_end(temp);
+    ptr[0] = 1;
+}
+
+static void read_cleared(sp_arena *arena) {
+    volatile char *ptr = sp_arena_alloc(arena, 8);
+    sp_arena_clear(arena);
+    printf("%d\n", ptr[0]);
+}
+
+static void read_unused(sp_arena *arena) {
+    volatile char *ptr = sp_arena_alloc(arena, 8);
+    printf("%d\n", ptr[64]);
+}
+
+static void read_snapshot_redzone(sp_arena *arena) {
+    char path[] = "/tmp/sp_arena_debug_XXXXXX";
+    int fd = mkstemp(path);
+    if (fd < 0) _exit(0);
+    close(fd);
+    volatile char *ptr = sp_arena_alloc(arena, 16);
+    sp_arena_alloc(arena, 16);
+    sp_arena_snapshot_write(arena, path);
+    unlink(path);
+    printf("%d\n", ptr[18]);
+}
+
+/* Redzones, unused and rewound memory fault under ASan, also after writing a snapshot */
+static void test_poisoning(void) {
+    sp_arena_config config = SP_ARENA_DEFAULT_CONFIG;
+    config.block_size = KB(4);
+    config.sync = SP_ARENA_SYNC_ATOMIC;
+    sp_arena *arena = sp_arena_create_with_config(config);
+    CHECK(arena);
+    CHECK(arena->config.sync == SP_ARENA_SYNC_MUTEX);
+
+    CHECK(child_dies(write_redzone, arena));
+    CHECK(child_dies(write_rewound, arena));
+    CHECK(child_dies(read_cleared, arena));
+    CHECK(child_dies(read_unused, arena));
+    sp_arena_destroy(arena);
+
+    config = SP_ARENA_DEFAULT_CONFIG;
+    config.fixed_size = true;
+    config.block_size = KB(4);
+    arena = sp_arena_create_with_config(config);
+    CHECK(arena);
+    CHECK(child_dies(read_snapshot_redzone, arena));
+    sp_arena_destroy(arena);
+}
+#endif
+
+int main(void) {
+    RUN_TEST(test_guard_pages);
+    RUN_TEST(test_clean_use);
+#if SP_ARENA_DEBUG && defined(TEST_ASAN)
+    RUN_TEST(test_poisoning);
+#endif
+    return TEST_RESULT();
+}
@@ -0,0 +1,169 @@
+/**
+ * @file test_reuse.c - Retained blocks, pools, decay and prefetching
+ */
+
+#include "test.h"
+
+/* Cleared and rewound blocks are reused from the free bins instead of allocated again */
+static void test_free_bins(void) {
+    sp_arena_config config = SP_ARENA_DEFAULT_CONFIG;
+    config.request_multiple = 2;
+    sp_arena *arena = sp_arena_create_with_config(config);
+    CHECK(arena);
+
+    for (int i = 0; i < 100; i++) memset(sp_arena_alloc(arena, 30000), 1, 30000);
+    size_t allocated = sp_arena_total_allocated(arena);
+    size_t chain = test_chain_length(arena);
+    sp_arena_clear(arena);
+    CHECK(test_chain_length(arena) == 1);
+
+    for (int i = 0; i < 100; i++) memset(sp_arena_alloc(arena, 30000), 1, 30000);
+    CHECK(sp_arena_total_allocated(arena) == allocated);
+    CHECK(test_chain_length(arena) == chain);
+
+    sp_arena_clear(arena);
+    size_t created = sp_arena_get_stats(arena).blocks_created;
+    for (int round = 0; round < 3; round++) {
+        sp_arena_temp_scope(arena) {
+            for (int i = 0; i < 100; i++) memset(sp_arena_alloc(arena, 30000), 2, 30000);
+        }
+    }
+    CHECK(sp_arena_total_allocated(arena) == allocated);
+    CHECK(sp_arena_get_stats(arena).blocks_created == created);
+    sp_arena_destroy(arena);
+}
+
+/* Retained large blocks serve later large requests of the same size class */
+static void test_retain_large(void) {
+    sp_arena_config config = SP_ARENA_DEFAULT_CONFIG;
+    config.retain_large = true;
+    sp_arena *arena = sp_arena_create_with_config(config);
+    CHECK(arena);
+
+    memset(sp_arena_alloc(arena, MB(1)), 1, MB(1));
+    size_t allocated = sp_arena_total_allocated(arena);
+    size_t created = sp_arena_get_stats(arena).blocks_created;
+    for (int round = 0; round < 4; round++) {
+        sp_arena_clear(arena);
+        CHECK(arena->large == NULL);
+        memset(sp_arena_alloc(arena, MB(1) - 100), 1, MB(1) - 100);
+    }
+    CHECK(sp_arena_total_allocated(arena) == allocated);
+    CHECK(sp_arena_get_stats(arena).blocks_created == created);
+    sp_arena_destroy(arena);
+}
+
+/* Released arenas are cleared, trimmed and handed out again */
+static void test_pool(void) {
+    sp_arena_pool *pool = sp_arena_pool_create(SP_ARENA_DEFAULT_CONFIG, 4, KB(256));
+    CHECK(pool);
+    CHECK(sp_arena_pool_prewarm(pool, 2) == 2);
+    CHECK(sp_arena_pool_prewarm(pool, 10) == 2);
+
+    sp_arena *a = sp_arena_pool_acquire(pool);
+    sp_arena *b = sp_arena_pool_acquire(pool);
+    sp_arena *c = sp_arena_pool_acquire(pool);
+    CHECK(a && b && c && a != b && b != c);
+    for (int i = 0; i < 100; i++) memset(sp_arena_alloc(a, 60000), 1, 60000);
+    sp_arena_pool_release(pool, a);
+    CHECK(sp_arena_total_allocated(a) <= KB(256));
+    CHECK(sp_arena_total_used(a) == 0);
+    CHECK(sp_arena_pool_acquire(pool) == a);
+    sp_arena_pool_release(pool, a);
+    sp_arena_pool_release(pool, b);
+    sp_arena_pool_release(pool, c);
+    sp_arena_pool_destroy(pool);
+
+    // Reserved arenas decommit down to the retained size
+    sp_arena_config config = SP_ARENA_DEFAULT_CONFIG;
+    config.reserve_size = GB(1);
+    pool = sp_arena_pool_create(config, 1, MB(1));
+    CHECK(pool);
+    sp_arena *vm = sp_arena_pool_acquire(pool);
+    CHECK(vm);
+    memset(sp_arena_alloc(vm, MB(10)), 1, MB(10));
+    sp_arena_pool_release(pool, vm);
+    CHECK(sp_arena_total_allocated(vm) == MB(1));
+    sp_arena_pool_destroy(pool);
+}
+
+/* Blocks left unused for decay_clears clears are freed, trim frees them on demand */
+static void test_decay_trim(void) {
+    sp_arena_config config = SP_ARENA_DEFAULT_CONFIG;
+    config.decay_clears = 2;
+    sp_arena *arena = sp_arena_create_with_config(config);
+    CHECK(arena);
+
+    for (int i = 0; i < 100; i++) memset(sp_arena_alloc(arena, 60000), 1, 60000);
+    size_t peak = sp_arena_total_allocated(arena);
+    sp_arena_clear(arena);
+    CHECK(sp_arena_total_allocated(arena) == peak);
+
+    for (int i = 0; i < 3; i++) memset(sp_arena_alloc(arena, 60000), 1, 60000);
+    size_t busy = sp_arena_total_allocated(arena) - peak;
+    sp_arena_clear(arena);
+    CHECK(sp_arena_total_allocated(arena) == peak);
+    sp_arena_clear(arena);
+    CHECK(sp_arena_total_allocated(arena) < peak);
+    CHECK(sp_arena_total_allocated(arena) >= KB(64) + busy);
+
+    sp_arena_trim(arena, 0);
+    CHECK(sp_arena_total_allocated(arena) == KB(64));
+    CHECK(sp_arena_alloc(arena, 100));
+    sp_arena_destroy(arena);
+}
+
+/* Passing the watermark provisions the next block before the current one runs out */
+static void test_prefetch(void) {
+    for (int populate = 0; populate < 2; populate++) {
+        sp_arena_config config = SP_ARENA_DEFAULT_CONFIG;
+        config.block_size = KB(64);
+        config.sync = SP_ARENA_SYNC_NONE;
+        config.prefetch_watermark = 0.75;
+        config.prefetch_populate = populate;
+        sp_arena *arena = sp_arena_create_with_config(config);
+        CHECK(arena);
+
+        for (int i = 0; i < (int)(KB(50) / 32); i++) CHECK(sp_arena_alloc(arena, 32));
+        sp_arena_stats stats = sp_arena_get_stats(arena);
+        CHECK(stats.block_count == 2 && stats.blocks_created == 2);
+        for (int i = 0; i < (int)(KB(20) / 32); i++) CHECK(sp_arena_alloc(arena, 32));
+        CHECK(sp_arena_get_stats(arena).blocks_created <= 3);
+
+        sp_arena_clear(arena);
+        for (int i = 0; i < 100000; i++) CHECK(sp_arena_alloc(arena, 32));
+        sp_arena_trim(arena, 0);
+        sp_arena_destroy(arena);
+    }
+
+    // Reserved arenas commit ahead instead
+    sp_arena_config config = SP_ARENA_DEFAULT_CONFIG;
+    config.reserve_size = MB(64);
+    config.commit_size = KB(64);
+    config.prefetch_watermark = 0.5;
+    config.prefetch_populate = true;
+    sp_arena *vm = sp_arena_create_with_config(config);
+    CHECK(vm);
+    for (int i = 0; i < 1100; i++) CHECK(sp_arena_alloc(vm, 32));
+    CHECK(sp_arena_total_allocated(vm) == KB(128));
+    CHECK(!sp_arena_alloc(vm, MB(80)));
+    sp_arena_destroy(vm);
+
+    config = SP_ARENA_DEFAULT_CONFIG;
+    config.prefetch_watermark = 1.0;
+    CHECK(!sp_arena_create_with_config(config));
+    config.prefetch_watermark = 0.5;
+    config.fixed_size = true;
+    sp_arena *fixed = sp_arena_create_with_config(config);
+    CHECK(fixed && fixed->current->limit == fixed->current->size);
+    sp_arena_destroy(fixed);
+}
+
+int main(void) {
+    RUN_TEST(test_free_bins);
+    RUN_TEST(test_retain_large);
+    RUN_TEST(test_pool);
+    RUN_TEST(test_decay_trim);
+    RUN_TEST(test_prefetch);
+    return TEST_RESULT();
+}
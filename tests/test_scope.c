@@ -0,0 +1,161 @@
+/**
+ * @file test_scope.c - Temporary scopes and scratch arenas
+ */
+
+#include "test.h"
+
+/* Nested scopes rewind everything allocated in them, large and retained blocks included */
+static void test_nested_scopes(void) {
+    sp_arena_config config = SP_ARENA_DEFAULT_CONFIG;
+    config.retain_large = true;
+    sp_arena *arena = sp_arena_create_with_config(config);
+    CHECK(arena);
+
+    sp_arena_alloc(arena, 100);
+    size_t used = sp_arena_total_used(arena);
+    size_t peak = 0;
+    for (int round = 0; round < 200; round++) {
+        sp_arena_temp_scope(arena) {
+            for (int i = 0; i < 10; i++) memset(sp_arena_alloc(arena, 30000), 1, 30000);
+            memset(sp_arena_alloc(arena, MB(1)), 2, MB(1));
+            sp_arena_temp_scope(arena) {
+                memset(sp_arena_alloc(arena, 50000), 3, 50000);
+                memset(sp_arena_alloc(arena, MB(2)), 4, MB(2));
+            }
+        }
+        CHECK(sp_arena_total_used(arena) == used);
+        if (round == 1) peak = sp_arena_total_allocated(arena);
+        CHECK(round < 1 || sp_arena_total_allocated(arena) == peak);
+    }
+    CHECK(arena->temp_depth == 0);
+    sp_arena_destroy(arena);
+}
+
+/* Ending a scope that an enclosing scope or a clear already ended does nothing */
+static void test_stale_scopes(void) {
+    sp_arena_config config = SP_ARENA_DEFAULT_CONFIG;
+    config.block_size = KB(4);
+    sp_arena *arena = sp_arena_create_with_config(config);
+    CHECK(arena);
+
+    // Outer ended first
+    sp_arena_temp outer = sp_arena_temp_begin(arena);
+    sp_arena_alloc(arena, 100);
+    sp_arena_temp inner = sp_arena_temp_begin(arena);
+    sp_arena_alloc(arena, 3000);
+    sp_arena_temp_end(outer);
+    CHECK(sp_arena_total_used(arena) == 0 && arena->temp_depth == 0);
+    sp_arena_temp_end(inner);
+    CHECK(sp_arena_total_used(arena) == 0);
+
+    // Ended twice, with a sibling begun at the same depth in between
+    sp_arena_temp first = sp_arena_temp_begin(arena);
+    sp_arena_temp_end(first);
+    sp_arena_temp second = sp_arena_temp_begin(arena);
+    CHECK(second.depth == first.depth && second.serial != first.serial);
+    CHECK(sp_arena_alloc(arena, 50));
+    sp_arena_temp_end(first);
+    CHECK(sp_arena_total_used(arena) >= 50);
+    sp_arena_temp_end(second);
+    CHECK(sp_arena_total_used(arena) == 0);
+
+    // Begun before a clear
+    for (int i = 0; i < 4; i++) CHECK(sp_arena_alloc(arena, 3000));
+    sp_arena_temp before = sp_arena_temp_begin(arena);
+    sp_arena_clear(arena);
+    sp_arena_temp after = sp_arena_temp_begin(arena);
+    sp_arena_temp_end(before);
+    CHECK(arena->temp_depth == 1);
+    memset(sp_arena_alloc(arena, 3000), 1, 3000);
+    memset(sp_arena_alloc(arena, 3000), 1, 3000);
+    sp_arena_temp_end(after);
+    CHECK(sp_arena_total_used(arena) == 0);
+    sp_arena_destroy(arena);
+}
+
+static int nest(sp_arena *arena, int depth) {
+    if (depth == 0) return sp_arena_alloc(arena, 8) != NULL;
+    sp_arena_temp temp = sp_arena_temp_begin(arena);
+    if (!temp.block) return 0;
+    int ok = nest(arena, depth - 1);
+    sp_arena_temp_end(temp);
+    return ok && sp_arena_total_used(arena) == temp.total_used;
+}
+
+/* Scopes nest past the inline serials and begin on a full fixed arena */
+static void test_deep_scopes(void) {
+    sp_arena_config config = SP_ARENA_DEFAULT_CONFIG;
+    config.block_size = 256;
+    config.fixed_size = true;
+    sp_arena *arena = sp_arena_create_with_config(config);
+    CHECK(arena);
+
+    while (sp_arena_alloc(arena, 8)) {}
+    size_t used = sp_arena_total_used(arena);
+    int ran = 0;
+    sp_arena_temp_scope(arena) {
+        ran = 1;
+    }
+    CHECK(ran && sp_arena_total_used(arena) == used);
+
+    sp_arena_clear(arena);
+    CHECK(nest(arena, 4 * SP_ARENA_INLINE_SCOPES));
+    CHECK(arena->temp_depth == 0);
+
+    sp_arena_temp outer = sp_arena_temp_begin(arena);
+    CHECK(nest(arena, 2 * SP_ARENA_INLINE_SCOPES));
+    sp_arena_temp_end(outer);
+    sp_arena_temp_end(outer);
+    CHECK(arena->temp_depth == 0 && sp_arena_total_used(arena) == 0);
+    sp_arena_destroy(arena);
+}
+
+static char *join(sp_arena *out, const char *a, const char *b) {
+    sp_arena_temp scratch = sp_arena_scratch_begin(&out, 1);
+    if (scratch.arena == out) return NULL;
+    char *tmp = sp_arena_alloc(scratch.arena, 256);
+    snprintf(tmp, 256, "%s%s", a, b);
+    char *result = sp_arena_strdup(out, tmp);
+    sp_arena_scratch_end(scratch);
+    return result;
+}
+
+/* Scratch arenas avoid the ones passed as conflicts and rewind on end */
+static void test_scratch(void) {
+    sp_arena *out = sp_arena_create();
+    CHECK(out);
+    char *joined = join(out, "ab", "cd");
+    CHECK(joined && strcmp(joined, "abcd") == 0);
+    sp_arena_destroy(out);
+
+    sp_arena_temp a = sp_arena_scratch_begin(NULL, 0);
+    CHECK(a.arena);
+    char *nested = join(a.arena, "ef", "gh");
+    CHECK(nested && strcmp(nested, "efgh") == 0);
+    sp_arena_temp b = sp_arena_scratch_begin(&a.arena, 1);
+    CHECK(b.arena && b.arena != a.arena);
+
+    // Every scratch arena conflicts
+    sp_arena *both[2] = { a.arena, b.arena };
+    sp_arena_temp none = sp_arena_scratch_begin(both, 2);
+    CHECK(none.arena == NULL && none.block == NULL);
+    sp_arena_scratch_end(none);
+
+    sp_arena_scratch_end(b);
+    sp_arena_scratch_end(a);
+    CHECK(sp_arena_total_used(a.arena) == 0 && sp_arena_total_used(b.arena) == 0);
+    sp_arena_scratch_release();
+
+    sp_arena_temp fresh = sp_arena_scratch_begin(NULL, 0);
+    CHECK(fresh.arena);
+    sp_arena_scratch_end(fresh);
+    sp_arena_scratch_release();
+}
+
+int main(void) {
+    RUN_TEST(test_nested_scopes);
+    RUN_TEST(test_stale_scopes);
+    RUN_TEST(test_deep_scopes);
+    RUN_TEST(test_scratch);
+    return TEST_RESULT();
+}
@@ -0,0 +1,113 @@
+/**
+ * @file test_shared.c - Arenas shared with forked processes
+ */
+
+#define _DEFAULT_SOURCE
+#include "test.h"
+#include <unistd.h>
+#include <sys/wait.h>
+
+#define WORKERS 8
+
+/* Forked workers allocate from one mapping and see each other's allocations */
+static void test_forked_workers(void) {
+#if SP_ARENA_THREAD_SAFE
+    sp_arena_sync_t modes[] = { SP_ARENA_SYNC_MUTEX, SP_ARENA_SYNC_ATOMIC };
+    for (size_t m = 0; m < ArrayLen(modes); m++) {
+        sp_arena_config config = SP_ARENA_DEFAULT_CONFIG;
+        config.block_size = MB(1);
+        config.sync = modes[m];
+        sp_arena *arena = sp_arena_create_shared(config);
+        CHECK(arena);
+
+        int **results = sp_arena_alloc_array(arena, int *, WORKERS);
+        CHECK(results);
+        memset(results, 0, WORKERS * sizeof(int *));
+        for (int w = 0; w < WORKERS; w++) {
+            pid_t pid = fork();
+            CHECK(pid >= 0);
+            if (pid == 0) {
+                int *values = NULL;
+                for (int i = 0; i < 1000; i++) {
+                    values = sp_arena_alloc_array(arena, int, 4);
+                    if (!values) _exit(1);
+                    values[0] = w;
+                }
+                results[w] = values;
+                sp_arena_destroy(arena);
+                _exit(0);
+            }
+        }
+        int failed = 0;
+        for (int w = 0; w < WORKERS; w++) {
+            int status = 0;
+            wait(&status);
+            failed |= !WIFEXITED(status) || WEXITSTATUS(status) != 0;
+        }
+        CHECK(!failed);
+        for (int w = 0; w < WORKERS; w++) CHECK(results[w] && results[w][0] == w);
+        CHECK(sp_arena_total_used(arena) >= (size_t)WORKERS * 1000 * 4 * sizeof(int));
+
+        sp_arena_clear(arena);
+        CHECK(sp_arena_total_used(arena) == 0);
+        CHECK(!sp_arena_alloc(arena, MB(2)));
+        sp_arena_destroy(arena);
+    }
+#endif
+}
+
+/* Only the sync modes that work across processes are accepted */
+static void test_shared_sync(void) {
+    sp_arena_config config = SP_ARENA_DEFAULT_CONFIG;
+    config.block_size = KB(64);
+    config.sync = SP_ARENA_SYNC_THREAD_CACHE;
+    CHECK(!sp_arena_create_shared(config));
+
+    config.sync = SP_ARENA_SYNC_MUTEX;
+    sp_arena *arena = sp_arena_create_shared(config);
+#if SP_ARENA_THREAD_SAFE
+    CHECK(arena && arena->config.sync == SP_ARENA_SYNC_MUTEX);
+    sp_arena_destroy(arena);
+#else
+    CHECK(!arena);
+    config.sync = SP_ARENA_SYNC_ATOMIC;
+    CHECK(!sp_arena_create_shared(config));
+#endif
+
+    config.sync = SP_ARENA_SYNC_NONE;
+    arena = sp_arena_create_shared(config);
+    CHECK(arena && arena->config.sync == SP_ARENA_SYNC_NONE);
+    CHECK(sp_arena_alloc(arena, 10));
+    sp_arena_destroy(arena);
+}
+
+/* Scopes on a shared arena begin when it is full, up to the serials it keeps inline */
+static void test_shared_scopes(void) {
+    sp_arena_config config = SP_ARENA_DEFAULT_CONFIG;
+    config.block_size = KB(4);
+    config.sync = SP_ARENA_SYNC_NONE;
+    sp_arena *arena = sp_arena_create_shared(config);
+    CHECK(arena);
+
+    while (sp_arena_alloc(arena, 8)) {}
+    sp_arena_clear(arena);
+    int ran = 0;
+    sp_arena_temp_scope(arena) {
+        ran = 1;
+    }
+    CHECK(ran);
+
+    sp_arena_temp temps[SP_ARENA_INLINE_SCOPES + 1];
+    for (int i = 0; i <= SP_ARENA_INLINE_SCOPES; i++) temps[i] = sp_arena_temp_begin(arena);
+    CHECK(temps[SP_ARENA_INLINE_SCOPES - 1].block && !temps[SP_ARENA_INLINE_SCOPES].block);
+    sp_arena_temp_end(temps[0]);
+    CHECK(arena->temp_depth == 0);
+    sp_arena_destroy(arena);
+}
+
+int main(void) {
+    RUN_TEST(test_forked_workers);
+    RUN_TEST(test_shared_sync);
+    RUN_TEST(test_shared_scopes);
+    return TEST_RESULT();
+}
@@ -0,0 +1,139 @@
+/**
+ * @file test_snapshot.c - Writing arenas to files and mapping them back read only
+ */
+
+#define _DEFAULT_SOURCE
+#include "test.h"
+#include <unistd.h>
+
+typedef struct {
+    int value;
+    size_t next;
+} test_link;
+
+static char snapshot_path[64];
+
+static int snapshot_file(void) {
+    snprintf(snapshot_path, sizeof(snapshot_path), "/tmp/sp_arena_snapshot_XXXXXX");
+    int fd = mkstemp(snapshot_path);
+    if (fd < 0) return 0;
+    close(fd);
+    return 1;
+}
+
+/* Offsets stored in the data survive the round trip, the mapped arena refuses changes */
+static void test_round_trip(void) {
+    CHECK(snapshot_file());
+    sp_arena_config config = SP_ARENA_DEFAULT_CONFIG;
+    config.fixed_size = true;
+    config.block_size = KB(64);
+    sp_arena *arena = sp_arena_create_with_config(config);
+    CHECK(arena);
+
+    size_t head = 0;
+    for (int i = 0; i < 100; i++) {
+        test_link *link = sp_arena_alloc_type(arena, test_link);
+        link->value = i;
+        link->next = head;
+        head = sp_arena_offset_of(arena, link);
+    }
+    size_t *root = sp_arena_alloc_type(arena, size_t);
+    *root = head;
+    size_t root_offset = sp_arena_offset_of(arena, root);
+    CHECK(sp_arena_offset_of(arena, NULL) == 0 && sp_arena_ptr_at(arena, 0) == NULL);
+    CHECK(sp_arena_snapshot_write(arena, snapshot_path));
+    sp_arena_destroy(arena);
+
+    sp_arena *mapped = sp_arena_create_from_snapshot(snapshot_path);
+    CHECK(mapped);
+    size_t offset = *(size_t *)sp_arena_ptr_at(mapped, root_offset);
+    int count = 0;
+    for (int expected = 99; offset; expected--) {
+        test_link *link = sp_arena_ptr_at(mapped, offset);
+        CHECK(link->value == expected);
+        offset = link->next;
+        count++;
+    }
+    CHECK(count == 100);
+
+    CHECK(!sp_arena_alloc(mapped, 8));
+    CHECK(sp_arena_get_last_error(mapped) == SP_ARENA_ERR_READ_ONLY);
+    CHECK(!sp_arena_calloc(mapped, 8));
+    sp_arena_clear(mapped);
+    sp_arena_temp_end(sp_arena_temp_begin(mapped));
+    sp_arena_trim(mapped, 0);
+    CHECK(*(size_t *)sp_arena_ptr_at(mapped, root_offset) == head);
+    sp_arena_destroy(mapped);
+    unlink(snapshot_path);
+}
+
+/* Mapped allocations keep their alignment and can't be resized, whatever the sync mode */
+static void test_alignment_resize(void) {
+    for (int vm = 0; vm < 2; vm++) {
+        CHECK(snapshot_file());
+        sp_arena_config config = SP_ARENA_DEFAULT_CONFIG;
+        if (vm) {
+            config.reserve_size = MB(1);
+        } else {
+            config.fixed_size = true;
+            config.block_size = KB(64);
+        }
+        sp_arena *arena = sp_arena_create_with_config(config);
+        CHECK(arena);
+
+        sp_arena_alloc(arena, 3);
+        char *line = sp_arena_alloc_aligned(arena, 100, 64);
+        char *wide = sp_arena_alloc_aligned(arena, 10, 256);
+        memset(line, 7, 100);
+        memset(wide, 9, 10);
+        size_t line_offset = sp_arena_offset_of(arena, line);
+        size_t wide_offset = sp_arena_offset_of(arena, wide);
+        CHECK(sp_arena_snapshot_write(arena, snapshot_path));
+        sp_arena_destroy(arena);
+
+        sp_arena *mapped = sp_arena_create_from_snapshot(snapshot_path);
+        CHECK(mapped);
+        char *mapped_line = sp_arena_ptr_at(mapped, line_offset);
+        char *mapped_wide = sp_arena_ptr_at(mapped, wide_offset);
+        CHECK(test_aligned(mapped_line, 64) && test_aligned(mapped_wide, 256));
+        CHECK(mapped_line[99] == 7 && mapped_wide[9] == 9);
+        CHECK(!sp_arena_resize(mapped, mapped_wide, 10, 5));
+        CHECK(sp_arena_get_last_error(mapped) == SP_ARENA_ERR_READ_ONLY);
+        CHECK(!sp_arena_resize(mapped, mapped_wide, 10, 50));
+        CHECK(mapped_wide[9] == 9);
+        sp_arena_destroy(mapped);
+        unlink(snapshot_path);
+    }
+}
+
+/* Arenas with several blocks or large allocations can't be written, bad files aren't mapped */
+static void test_invalid_snapshots(void) {
+    CHECK(snapshot_file());
+    sp_arena_config config = SP_ARENA_DEFAULT_CONFIG;
+    config.block_size = KB(4);
+    sp_arena *arena = sp_arena_create_with_config(config);
+    CHECK(arena);
+    sp_arena_alloc(arena, KB(3));
+    sp_arena_alloc(arena, KB(3));
+    CHECK(!sp_arena_snapshot_write(arena, snapshot_path));
+    sp_arena_clear(arena);
+    sp_arena_alloc(arena, KB(8));
+    CHECK(!sp_arena_snapshot_write(arena, snapshot_path));
+    sp_arena_destroy(arena);
+
+    // Garbage and truncated files
+    FILE *file = fopen(snapshot_path, "wb");
+    CHECK(file);
+    fputs("not a snapshot, just some text that is long enough to hold a header", file);
+    fclose(file);
+    CHECK(!sp_arena_create_from_snapshot(snapshot_path));
+    CHECK(!sp_arena_create_from_snapshot("/nonexistent/snapshot"));
+    unlink(snapshot_path);
+}
+
+int main(void) {
+    RUN_TEST(test_round_trip);
+    RUN_TEST(test_alignment_resize);
+    RUN_TEST(test_invalid_snapshots);
+    return TEST_RESULT();
+}
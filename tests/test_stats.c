@@ -0,0 +1,105 @@
+/**
+ * @file test_stats.c - Usage counters, peak tracking and allocation profiling
+ */
+
+#include "test.h"
+
+/* Block counters, tail waste and, with SP_ARENA_STATS, allocation and padding counts */
+static void test_counters(void) {
+    sp_arena_config config = SP_ARENA_DEFAULT_CONFIG;
+    config.block_size = KB(4);
+    sp_arena *arena = sp_arena_create_with_config(config);
+    CHECK(arena);
+
+    for (int i = 0; i < 1000; i++) CHECK(sp_arena_alloc_aligned(arena, 3, 8));
+    CHECK(sp_arena_alloc(arena, MB(1)));
+    sp_arena_stats stats = sp_arena_get_stats(arena);
+    CHECK(stats.block_count == stats.blocks_created && stats.block_count > 2);
+    CHECK(stats.tail_waste > 0 && stats.tail_waste < stats.block_count * 64);
+    CHECK(stats.total_allocated == sp_arena_total_allocated(arena));
+    CHECK(stats.total_used == sp_arena_total_used(arena));
+#if SP_ARENA_STATS
+    CHECK(stats.allocations == 1001);
+    CHECK(stats.padding > 0 && stats.padding <= 1000 * 5);
+#endif
+    CHECK(sp_arena_utilization(arena) > 0.0f && sp_arena_utilization(arena) <= 1.0f);
+
+    size_t used = stats.total_used;
+    sp_arena_clear(arena);
+    stats = sp_arena_get_stats(arena);
+    CHECK(stats.total_used == 0 && stats.peak_used == used);
+
+    stats = sp_arena_get_stats(NULL);
+    CHECK(stats.total_allocated == 0 && stats.block_count == 0);
+    sp_arena_destroy(arena);
+}
+
+/* The peak keeps the high point of resizes that grow and then shrink an allocation */
+static void test_peak_resize(void) {
+    sp_arena_sync_t modes[] = { SP_ARENA_SYNC_MUTEX, SP_ARENA_SYNC_ATOMIC, SP_ARENA_SYNC_NONE };
+    for (size_t m = 0; m < ArrayLen(modes); m++) {
+        sp_arena_config config = SP_ARENA_DEFAULT_CONFIG;
+        config.sync = modes[m];
+        sp_arena *arena = sp_arena_create_with_config(config);
+        CHECK(arena);
+
+        void *ptr = sp_arena_alloc(arena, 100);
+        ptr = sp_arena_resize(arena, ptr, 100, 5000);
+        ptr = sp_arena_resize(arena, ptr, 5000, 10);
+        CHECK(ptr);
+        sp_arena_stats stats = sp_arena_get_stats(arena);
+        CHECK(stats.peak_used >= 5000);
+#if !SP_ARENA_DEBUG
+        CHECK(stats.total_used < 100);
+#endif
+
+        void *big = sp_arena_alloc(arena, MB(1));
+        big = sp_arena_resize(arena, big, MB(1), 100);
+        CHECK(big && sp_arena_get_stats(arena).peak_used >= MB(1));
+
+        sp_arena_temp_scope(arena) {
+            CHECK(sp_arena_alloc(arena, MB(2)));
+        }
+        CHECK(sp_arena_get_stats(arena).peak_used >= MB(2));
+        sp_arena_destroy(arena);
+    }
+}
+
+#if SP_ARENA_PROFILE
+/* The allocation macros record the line they were called from */
+static void test_profile(void) {
+    sp_arena *arena = sp_arena_create();
+    CHECK(arena);
+    sp_arena_profile_reset();
+
+    int line = __LINE__ + 1;
+    for (int i = 0; i < 10; i++) sp_arena_alloc(arena, 100);
+    sp_arena_calloc(arena, 7);
+
+    sp_arena_callsite sites[8];
+    size_t count = sp_arena_profile_callsites(sites, ArrayLen(sites));
+    CHECK(count == 2);
+    int found = 0;
+    for (size_t i = 0; i < count; i++) {
+        CHECK(strstr(sites[i].file, "test_stats.c") != NULL);
+        if (sites[i].line == line) {
+            CHECK(sites[i].count == 10 && sites[i].requested == 1000 && sites[i].consumed >= 1000);
+            found = 1;
+        }
+    }
+    CHECK(found);
+
+    sp_arena_profile_reset();
+    CHECK(sp_arena_profile_callsites(sites, ArrayLen(sites)) == 0);
+    sp_arena_destroy(arena);
+}
+#endif
+
+int main(void) {
+    RUN_TEST(test_counters);
+    RUN_TEST(test_peak_resize);
+#if SP_ARENA_PROFILE
+    RUN_TEST(test_profile);
+#endif
+    return TEST_RESULT();
+}
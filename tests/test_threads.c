@@ -0,0 +1,188 @@
+/**
+ * @file test_threads.c - Concurrent allocation in every thread safe sync mode
+ *
+ * Worker failures are counted rather than returned, the checks run on the joining thread.
+ * Build with -fsanitize=thread to check the lock-free modes for races.
+ */
+
+#include "test.h"
+
+#if SP_ARENA_THREAD_SAFE
+#include <pthread.h>
+
+#define THREADS 8
+
+static sp_arena *shared_arena;
+static int worker_errors;
+
+static void *alloc_worker(void *arg) {
+    intptr_t id = (intptr_t)arg;
+    for (int round = 0; round < 2000; round++) {
+        int *values = sp_arena_alloc_array(shared_arena, int, 8);
+        if (!values || !test_aligned(values, SP_ARENA_ALIGNOF(int))) {
+            __atomic_add_fetch(&worker_errors, 1, __ATOMIC_RELAXED);
+            return NULL;
+        }
+        for (int i = 0; i < 8; i++) values[i] = (int)id * 100000 + round;
+        for (int i = 0; i < 8; i++) {
+            if (values[i] != (int)id * 100000 + round) __atomic_add_fetch(&worker_errors, 1, __ATOMIC_RELAXED);
+        }
+
+        // Requests past the thread chunk size and the block size take the locked paths
+        char *big = sp_arena_alloc(shared_arena, round % 50 == 0 ? KB(80) : 5000);
+        if (!big) {
+            __atomic_add_fetch(&worker_errors, 1, __ATOMIC_RELAXED);
+            return NULL;
+        }
+        memset(big, (int)id, 5000);
+    }
+    return NULL;
+}
+
+static int run_workers(void *(*worker)(void *)) {
+    pthread_t threads[THREADS];
+    worker_errors = 0;
+    for (intptr_t i = 0; i < THREADS; i++) {
+        if (pthread_create(&threads[i], NULL, worker, (void *)i) != 0) return 0;
+    }
+    for (int i = 0; i < THREADS; i++) pthread_join(threads[i], NULL);
+    return worker_errors == 0;
+}
+
+/* Threads allocating from one arena get disjoint memory, before and after clears */
+static void test_concurrent_alloc(void) {
+    sp_arena_sync_t modes[] = { SP_ARENA_SYNC_MUTEX, SP_ARENA_SYNC_THREAD_CACHE, SP_ARENA_SYNC_ATOMIC };
+    for (size_t m = 0; m < ArrayLen(modes); m++) {
+        sp_arena_config config = SP_ARENA_DEFAULT_CONFIG;
+        config.sync = modes[m];
+        shared_arena = sp_arena_create_with_config(config);
+        CHECK(shared_arena);
+
+        for (int round = 0; round < 3; round++) {
+            CHECK(run_workers(alloc_worker));
+            CHECK(sp_arena_total_used(shared_arena) >= (size_t)THREADS * 2000 * (8 * sizeof(int) + 5000));
+            sp_arena_clear(shared_arena);
+        }
+
+        sp_arena_temp_scope(shared_arena) {
+            CHECK(run_workers(alloc_worker));
+        }
+        CHECK(sp_arena_total_used(shared_arena) == 0);
+        sp_arena_destroy(shared_arena);
+    }
+}
+
+/* A reserved arena grows in place while threads bump it concurrently */
+static void test_concurrent_vm(void) {
+    sp_arena_sync_t modes[] = { SP_ARENA_SYNC_MUTEX, SP_ARENA_SYNC_THREAD_CACHE, SP_ARENA_SYNC_ATOMIC };
+    for (size_t m = 0; m < ArrayLen(modes); m++) {
+        sp_arena_config config = SP_ARENA_DEFAULT_CONFIG;
+        config.sync = modes[m];
+        config.reserve_size = GB(4);
+        config.decommit_on_clear = true;
+        shared_arena = sp_arena_create_with_config(config);
+        CHECK(shared_arena);
+
+        CHECK(run_workers(alloc_worker));
+        CHECK(shared_arena->first == shared_arena->current && !shared_arena->first->next);
+        sp_arena_clear(shared_arena);
+        CHECK(run_workers(alloc_worker));
+        sp_arena_destroy(shared_arena);
+    }
+}
+
+static void *scratch_worker(void *arg) {
+    Unused(arg);
+    for (int i = 0; i < 5000; i++) {
+        sp_arena_temp outer = sp_arena_scratch_begin(NULL, 0);
+        sp_arena_temp inner = sp_arena_scratch_begin(&outer.arena, 1);
+        if (!outer.arena || !inner.arena || inner.arena == outer.arena) {
+            __atomic_add_fetch(&worker_errors, 1, __ATOMIC_RELAXED);
+            return NULL;
+        }
+        char *tmp = sp_arena_alloc(inner.arena, 64);
+        snprintf(tmp, 64, "scratch %d", i);
+        char *copy = sp_arena_strdup(outer.arena, tmp);
+        sp_arena_scratch_end(inner);
+        if (strncmp(copy, "scratch ", 8) != 0) __atomic_add_fetch(&worker_errors, 1, __ATOMIC_RELAXED);
+        sp_arena_scratch_end(outer);
+        if (sp_arena_total_used(outer.arena) != 0) __atomic_add_fetch(&worker_errors, 1, __ATOMIC_RELAXED);
+    }
+    sp_arena_scratch_release();
+    return NULL;
+}
+
+/* Every thread gets its own scratch arenas */
+static void test_thread_scratch(void) {
+    CHECK(run_workers(scratch_worker));
+}
+
+static void *small_worker(void *arg) {
+    Unused(arg);
+    for (int i = 0; i < 50000; i++) {
+        unsigned char *ptr = sp_arena_alloc(shared_arena, 24);
+        if (!ptr) {
+            __atomic_add_fetch(&worker_errors, 1, __ATOMIC_RELAXED);
+            return NULL;
+        }
+        memset(ptr, 0x5A, 24);
+    }
+    return NULL;
+}
+
+/* The prefetch helper thread provisions blocks while workers allocate */
+static void test_prefetch_thread(void) {
+    sp_arena_sync_t modes[] = { SP_ARENA_SYNC_MUTEX, SP_ARENA_SYNC_THREAD_CACHE, SP_ARENA_SYNC_ATOMIC };
+    for (size_t m = 0; m < ArrayLen(modes); m++) {
+        sp_arena_config config = SP_ARENA_DEFAULT_CONFIG;
+        config.block_size = KB(64);
+        config.sync = modes[m];
+        config.prefetch_watermark = 0.75;
+        config.prefetch_thread = true;
+        config.prefetch_populate = m & 1;
+        shared_arena = sp_arena_create_with_config(config);
+        CHECK(shared_arena);
+
+        CHECK(run_workers(small_worker));
+        CHECK(sp_arena_total_used(shared_arena) >= (size_t)THREADS * 50000 * 24);
+        sp_arena_clear(shared_arena);
+        CHECK(run_workers(small_worker));
+        sp_arena_destroy(shared_arena);
+    }
+}
+
+static sp_arena_pool *shared_pool;
+
+static void *pool_worker(void *arg) {
+    Unused(arg);
+    for (int i = 0; i < 200; i++) {
+        sp_arena *arena = sp_arena_pool_acquire(shared_pool);
+        if (!arena || sp_arena_total_used(arena) != 0) {
+            __atomic_add_fetch(&worker_errors, 1, __ATOMIC_RELAXED);
+            return NULL;
+        }
+        memset(sp_arena_alloc(arena, 20000), 1, 20000);
+        sp_arena_pool_release(shared_pool, arena);
+    }
+    return NULL;
+}
+
+/* Pools hand each arena to one thread at a time */
+static void test_concurrent_pool(void) {
+    shared_pool = sp_arena_pool_create(SP_ARENA_DEFAULT_CONFIG, 4, KB(64));
+    CHECK(shared_pool);
+    CHECK(run_workers(pool_worker));
+    sp_arena_pool_destroy(shared_pool);
+}
+#endif
+
+int main(void) {
+#if SP_ARENA_THREAD_SAFE
+    RUN_TEST(test_concurrent_alloc);
+    RUN_TEST(test_concurrent_vm);
+    RUN_TEST(test_thread_scratch);
+    RUN_TEST(test_prefetch_thread);
+    RUN_TEST(test_concurrent_pool);
+#endif
+    return TEST_RESULT();
+}
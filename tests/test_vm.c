@@ -0,0 +1,106 @@
+/**
+ * @file test_vm.c - Reserved address space, huge pages and NUMA placement
+ */
+
+#include "test.h"
+
+/* A reserved arena is one block that commits pages as it grows and can give them back */
+static void test_reserve_commit(void) {
+    sp_arena_config config = SP_ARENA_DEFAULT_CONFIG;
+    config.reserve_size = GB(16);
+    config.commit_size = KB(64);
+    config.decommit_on_clear = true;
+    sp_arena *arena = sp_arena_create_with_config(config);
+    CHECK(arena);
+    CHECK(arena->reserved >= GB(16));
+    CHECK(sp_arena_total_allocated(arena) == KB(64));
+
+    // Growing the last allocation never moves it
+    char *ptr = sp_arena_alloc(arena, 10);
+    for (size_t size = 10; size < MB(64); size *= 2) {
+        char *grown = sp_arena_resize(arena, ptr, size, size * 2);
+#if !SP_ARENA_DEBUG
+        CHECK(grown == ptr);
+#endif
+        ptr = grown;
+        CHECK(ptr);
+        memset(ptr, 1, size * 2);
+    }
+    CHECK(!arena->first->next);
+    CHECK(sp_arena_total_allocated(arena) >= MB(64) && sp_arena_total_allocated(arena) % KB(64) == 0);
+
+    sp_arena_clear(arena);
+    CHECK(sp_arena_total_allocated(arena) == KB(64));
+    char *again = sp_arena_alloc(arena, MB(2));
+    CHECK(again == sp_arena_block_memory(arena->first));
+    memset(again, 2, MB(2));
+
+    // Running past the reservation fails without creating another block
+    CHECK(!sp_arena_alloc(arena, GB(17)));
+    CHECK(sp_arena_get_last_error(arena) != SP_ARENA_ERR_NONE);
+    CHECK(!arena->first->next);
+    sp_arena_trim(arena, 0);
+    CHECK(sp_arena_total_allocated(arena) >= MB(2));
+    sp_arena_destroy(arena);
+}
+
+/* Rewinding a reserved arena keeps its pages committed unless it is cleared with decommit */
+static void test_reserve_rewind(void) {
+    sp_arena_config config = SP_ARENA_DEFAULT_CONFIG;
+    config.reserve_size = MB(256);
+    sp_arena *arena = sp_arena_create_with_config(config);
+    CHECK(arena);
+
+    sp_arena_alloc(arena, 64);
+    size_t committed = 0;
+    for (int round = 0; round < 3; round++) {
+        sp_arena_temp temp = sp_arena_temp_begin(arena);
+        memset(sp_arena_alloc(arena, MB(8)), 3, MB(8));
+        if (round == 0) committed = sp_arena_total_allocated(arena);
+        sp_arena_temp_end(temp);
+        CHECK(sp_arena_total_allocated(arena) == committed);
+    }
+    sp_arena_clear(arena);
+    CHECK(sp_arena_total_allocated(arena) == committed);
+    sp_arena_destroy(arena);
+}
+
+/* Huge page and NUMA requests fall back to regular pages where the system has none */
+static void test_huge_numa(void) {
+    sp_arena_config config = SP_ARENA_DEFAULT_CONFIG;
+    config.huge_page_size = MB(2);
+    config.numa_policy = SP_ARENA_NUMA_LOCAL;
+    sp_arena *arena = sp_arena_create_with_config(config);
+    CHECK(arena);
+    CHECK(test_aligned(arena->first, MB(2)));
+    for (int i = 0; i < 100; i++) {
+        char *ptr = sp_arena_alloc(arena, 100000);
+        CHECK(ptr);
+        memset(ptr, 1, 100000);
+    }
+    char *big = sp_arena_alloc(arena, MB(5));
+    CHECK(big);
+    memset(big, 2, MB(5));
+    sp_arena_destroy(arena);
+
+    config.reserve_size = GB(4);
+    config.numa_policy = SP_ARENA_NUMA_NODE;
+    config.numa_node = 0;
+    arena = sp_arena_create_with_config(config);
+    CHECK(arena);
+    char *ptr = sp_arena_alloc(arena, MB(9));
+    CHECK(ptr);
+    memset(ptr, 3, MB(9));
+    CHECK(sp_arena_total_allocated(arena) % MB(2) == 0);
+    sp_arena_destroy(arena);
+
+    config.huge_page_size = 12345;
+    CHECK(!sp_arena_create_with_config(config));
+}
+
+int main(void) {
+    RUN_TEST(test_reserve_commit);
+    RUN_TEST(test_reserve_rewind);
+    RUN_TEST(test_huge_numa);
+    return TEST_RESULT();
+}